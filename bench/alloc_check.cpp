@@ -0,0 +1,171 @@
+// Checks that relaying allocates nothing once a session runs. operator new
+// and operator delete of this binary count every call, a CONNECT stream
+// through the proxy to a local echo server relays a warm-up amount of
+// data, then the given amount in both directions, and the check fails if
+// anything in the process allocated during the second part.
+//
+//   alloc_check [--warmup-mb 16] [--size-mb 1024] [--chunk 65536]
+//
+// The client and the echo server use blocking calls on buffers allocated
+// before the warm-up, so every allocation counted belongs to the proxy.
+// Exits with EXIT_FAILURE if the count moved.
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "bench_util.h"
+#include "socks5_client.h"
+
+namespace {
+
+std::atomic<uint64_t> allocations(0);
+
+void* counted_alloc(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+}    // namespace
+
+void* operator new(std::size_t size) {
+    void* p = counted_alloc(size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_alloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_alloc(size);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete[](void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+struct options {
+    size_t warmup_mb = 16;
+    size_t size_mb = 1024;
+    size_t chunk = 65536;
+};
+
+// sends bytes through the stream in chunks and reads every chunk back
+void echo_through(asio::ip::tcp::socket& socket, std::vector<uint8_t>& buffer,
+                  uint64_t bytes) {
+    for (uint64_t sent = 0; sent < bytes; sent += buffer.size()) {
+        asio::write(socket, asio::buffer(buffer));
+        asio::read(socket, asio::buffer(buffer));
+    }
+}
+
+bool parse_options(int argc, char* argv[], options& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string name = argv[i];
+        std::string value = argv[i + 1];
+        if (name == "--warmup-mb") {
+            opts.warmup_mb = parse_size_list(value).at(0);
+        } else if (name == "--size-mb") {
+            opts.size_mb = parse_size_list(value).at(0);
+        } else if (name == "--chunk") {
+            opts.chunk = parse_size_list(value).at(0);
+        } else {
+            return false;
+        }
+    }
+    return argc % 2 == 1 && opts.chunk > 0;
+}
+
+}    // namespace
+
+int main(int argc, char* argv[]) {
+    options opts;
+    try {
+        if (!parse_options(argc, argv, opts)) {
+            std::fprintf(stderr,
+                         "usage : %s [--warmup-mb 16] [--size-mb 1024] "
+                         "[--chunk 65536]\n",
+                         argv[0]);
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    uint64_t relayed = 0;
+    try {
+        bench_proxy proxy(1, nlohmann::json::object());
+        loopback_server server(
+            asio::ip::address_v4::loopback(),
+            [](asio::ip::tcp::socket& socket) {
+                uint8_t buffer[65536];
+                asio::error_code ec;
+                while (!ec) {
+                    size_t n = socket.read_some(asio::buffer(buffer), ec);
+                    if (!ec) {
+                        asio::write(socket, asio::buffer(buffer, n), ec);
+                    }
+                }
+            });
+
+        std::printf("%s\n", build_description().c_str());
+
+        asio::io_context ioc;
+        asio::ip::tcp::socket socket(ioc);
+        socket.connect(proxy.get_endpoint());
+        socket.set_option(asio::ip::tcp::no_delay(true));
+        socks5_negotiate(socket, "", "");
+        const asio::ip::tcp::endpoint& target = server.get_endpoint();
+        socks5_request(
+            socket, SocksV5::RequestCMD::Connect,
+            socks5_address::from_ip(target.address(), target.port()));
+
+        std::vector<uint8_t> buffer(opts.chunk, 0x5a);
+        echo_through(socket, buffer, opts.warmup_mb << 20);
+
+        uint64_t before = allocations.load();
+        echo_through(socket, buffer, opts.size_mb << 20);
+        relayed = allocations.load() - before;
+
+        asio::error_code ec;
+        socket.shutdown(asio::ip::tcp::socket::shutdown_send, ec);
+        while (!ec) {
+            socket.read_some(asio::buffer(buffer), ec);
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    std::printf("%zu MB echoed after %zu MB of warm-up, %" PRIu64
+                " allocations\n",
+                opts.size_mb, opts.warmup_mb, relayed);
+    if (relayed != 0) {
+        std::printf("FAILED : relaying allocated\n");
+        return EXIT_FAILURE;
+    }
+    std::printf("OK\n");
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "bench_util.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+#include <ctime>
+
+bench_proxy::bench_proxy(size_t thread_num, const nlohmann::json& config) {
+    // a port nothing listens on right now
+    {
+        asio::io_context ioc;
+        asio::ip::tcp::acceptor probe(
+            ioc, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+        endpoint = probe.local_endpoint();
+    }
+
+    nlohmann::json data = {
+        {"server",
+         {{"host", "127.0.0.1"},
+          {"port", endpoint.port()},
+          {"thread_num", thread_num}}},
+        {"log", {{"level", "warn"}}},
+        {"supported-methods", {0}},
+        {"timeout", 60},
+    };
+    data.merge_patch(config);
+    endpoint.port(data["server"]["port"].get<uint16_t>());
+
+    // the parser only reads files
+    char path[] = "/tmp/socks_bench_XXXXXX";
+    int fd = ::mkstemp(path);
+    if (fd < 0) {
+        throw std::runtime_error("failed to create a configuration file");
+    }
+    std::string text = data.dump();
+    bool written = ::write(fd, text.data(), text.size()) ==
+                   static_cast<ssize_t>(text.size());
+    ::close(fd);
+    auto parsed = written ? ServerParser::load_config_file(path) : nullptr;
+    std::remove(path);
+    if (!parsed) {
+        throw std::runtime_error("bad benchmark configuration : " + text);
+    }
+    ServerParser::publish(std::move(parsed));
+
+    const ServerParser* current = ServerParser::global_config();
+    Logger::SetLevel(current->get_log_level());
+    server.reset(new Socks5Server(current->get_host(), current->get_port(),
+                                  current->get_thread_num()));
+    thread = std::thread([this]() { server->start(); });
+
+    // start returns at once if the proxy failed to listen
+    asio::io_context ioc;
+    for (int i = 0; i < 500; i++) {
+        asio::ip::tcp::socket socket(ioc);
+        asio::error_code ec;
+        socket.connect(endpoint, ec);
+        if (!ec) {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::raise(SIGINT);
+    thread.join();
+    throw std::runtime_error("the proxy did not start");
+}
+
+bench_proxy::~bench_proxy() {
+    std::raise(SIGINT);
+    thread.join();
+}
+
+loopback_server::loopback_server(const asio::ip::address& address,
+                                 handler_type handler)
+    : handler(std::move(handler)),
+      acceptor(ioc, asio::ip::tcp::endpoint(address, 0)),
+      endpoint(acceptor.local_endpoint()) {
+    do_accept();
+    thread = std::thread([this]() { ioc.run(); });
+}
+
+loopback_server::~loopback_server() {
+    asio::post(ioc, [this]() {
+        asio::error_code ignore_ec;
+        acceptor.close(ignore_ec);
+    });
+    thread.join();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto&& connection : connections) {
+        connection.join();
+    }
+}
+
+void loopback_server::do_accept() {
+    acceptor.async_accept([this](std::error_code ec,
+                                 asio::ip::tcp::socket socket) {
+        if (ec) {
+            return;
+        }
+        asio::error_code ignore_ec;
+        socket.set_option(asio::ip::tcp::no_delay(true), ignore_ec);
+
+        // handlers block, the accepting thread goes on at once
+        std::lock_guard<std::mutex> lock(mutex);
+        connections.emplace_back(
+            [this](asio::ip::tcp::socket&& socket) { handler(socket); },
+            std::move(socket));
+        do_accept();
+    });
+}
+
+void start_barrier::arrive_and_wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (--count == 0) {
+        arrived.notify_all();
+        return;
+    }
+    arrived.wait(lock, [this]() { return count == 0; });
+}
+
+std::string build_description() {
+#ifdef SOCKS_COROUTINE_SESSION
+    std::string text = "coroutine sessions";
+#else
+    std::string text = "callback sessions";
+#endif
+#ifdef ASIO_HAS_IO_URING
+    text += ", io_uring";
+#else
+    text += ", epoll";
+#endif
+#ifdef NDEBUG
+    text += ", release build";
+#else
+    text += ", debug build";
+#endif
+    return text;
+}
+
+double process_cpu_seconds() {
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+double thread_cpu_seconds() {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint64_t percentile(std::vector<uint64_t>& samples, double p) {
+    if (samples.empty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    // nearest rank
+    size_t rank = static_cast<size_t>(std::ceil(p * samples.size()));
+    return samples[rank == 0 ? 0 : std::min(rank, samples.size()) - 1];
+}
+
+std::vector<size_t> parse_size_list(const std::string& text) {
+    std::vector<size_t> values;
+    size_t begin = 0;
+    while (begin <= text.size()) {
+        size_t end = text.find(',', begin);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string item = text.substr(begin, end - begin);
+        if (item.empty() ||
+            item.find_first_not_of("0123456789") != std::string::npos) {
+            throw std::invalid_argument("bad number list : " + text);
+        }
+        values.push_back(std::stoul(item));
+        begin = end + 1;
+    }
+    return values;
+}
+
+nlohmann::json load_json_file(const std::string& file) {
+    std::ifstream f(file);
+    nlohmann::json data = nlohmann::json::parse(f, nullptr, false);
+    if (!data.is_object()) {
+        throw std::runtime_error(file + " is not a json object");
+    }
+    return data;
+}
\ No newline at end of file
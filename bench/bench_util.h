@@ -0,0 +1,97 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "nlohmann/json.hpp"
+#include "socks_server.h"
+
+// The proxy running in this process, listening on a free loopback port.
+// Socks5Server shuts spdlog down when it is destroyed, so a benchmark
+// starts one proxy and runs every case against it.
+class bench_proxy : public noncopyable {
+public:
+    // config is merged into the benchmark configuration, which listens on
+    // 127.0.0.1 with thread_num threads and logs warnings only
+    bench_proxy(size_t thread_num, const nlohmann::json& config);
+
+    // stops the proxy as SIGINT would
+    ~bench_proxy();
+
+    inline const asio::ip::tcp::endpoint& get_endpoint() const {
+        return endpoint;
+    }
+
+private:
+    asio::ip::tcp::endpoint endpoint;
+    std::unique_ptr<Socks5Server> server;
+    std::thread thread;
+};
+
+// Local server that runs handler on a thread of its own for every
+// connection it accepts, the destructor waits for every handler.
+class loopback_server : public noncopyable {
+public:
+    using handler_type = std::function<void(asio::ip::tcp::socket&)>;
+
+    loopback_server(const asio::ip::address& address, handler_type handler);
+
+    ~loopback_server();
+
+    inline const asio::ip::tcp::endpoint& get_endpoint() const {
+        return endpoint;
+    }
+
+private:
+    void do_accept();
+
+private:
+    handler_type handler;
+    asio::io_context ioc;
+    asio::ip::tcp::acceptor acceptor;
+    asio::ip::tcp::endpoint endpoint;
+    std::thread thread;
+
+    std::mutex mutex;
+    std::vector<std::thread> connections;
+};
+
+// Lets a group of threads start a measurement at the same time.
+class start_barrier : public noncopyable {
+public:
+    explicit start_barrier(size_t count) : count(count) {}
+
+    // blocks until count threads have arrived
+    void arrive_and_wait();
+
+private:
+    std::mutex mutex;
+    std::condition_variable arrived;
+    size_t count;
+};
+
+// session engine, asio backend and build type the numbers were taken with
+std::string build_description();
+
+// cpu seconds used by the whole process and by the calling thread
+double process_cpu_seconds();
+
+double thread_cpu_seconds();
+
+inline uint64_t now_ns() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+
+// p in [0, 1], sorts samples, 0 if there are none
+uint64_t percentile(std::vector<uint64_t>& samples, double p);
+
+// "1,2,8" -> {1, 2, 8}, throws std::invalid_argument on anything else
+std::vector<size_t> parse_size_list(const std::string& text);
+
+// json object read from file, throws std::runtime_error if it is not one
+nlohmann::json load_json_file(const std::string& file);
\ No newline at end of file
@@ -0,0 +1,325 @@
+// Handshake rate of the proxy on loopback. Every client thread opens a
+// connection to the proxy, negotiates, sends a CONNECT to a local listener
+// and waits for the reply, then starts over, for the given duration. The
+// listener closes every connection it accepts, so the proxy closes the
+// client connection right after the reply and ephemeral ports of neither
+// side end up in TIME_WAIT.
+//
+//   connect_bench [--auth none,password] [--target ipv4,ipv6,domain]
+//                 [--concurrency 1,8,64] [--duration 3] [--threads 1]
+//                 [--domain localhost] [--config file.json]
+//
+// domain targets are resolved by the proxy through the system resolver,
+// the name should be in the hosts file so that no DNS server is involved.
+// The listener accepts on 127.0.0.1 and ::1 with the same port.
+//
+// The latency is from the start of the TCP connect to the CONNECT reply,
+// cpu of the proxy is the process minus the client and listener threads.
+
+#include <algorithm>
+#include <cstdio>
+#include <future>
+
+#include "bench_util.h"
+#include "socks5_client.h"
+
+namespace {
+
+const char* bench_username = "bench-user";
+const char* bench_password = "bench-passwd";
+
+struct options {
+    std::vector<std::string> auth = {"none", "password"};
+    std::vector<std::string> targets = {"ipv4", "ipv6", "domain"};
+    std::vector<size_t> concurrency = {1, 8, 64};
+    size_t duration = 3;
+    size_t threads = 1;
+    std::string domain = "localhost";
+    nlohmann::json config = nlohmann::json::object();
+};
+
+// Accepts on 127.0.0.1 and, if it can, on ::1 with the same port, and
+// closes every connection at once.
+class closing_listener : public noncopyable {
+public:
+    closing_listener()
+        : v4(ioc, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(),
+                                          0)),
+          v6(ioc),
+          port(v4.local_endpoint().port()) {
+        asio::error_code ec;
+        v6.open(asio::ip::tcp::v6(), ec);
+        if (!ec) {
+            v6.set_option(asio::ip::v6_only(true), ec);
+            v6.bind(asio::ip::tcp::endpoint(asio::ip::address_v6::loopback(),
+                                            port),
+                    ec);
+        }
+        if (!ec) {
+            v6.listen(asio::socket_base::max_listen_connections, ec);
+        }
+        if (ec) {
+            v6.close(ec);
+        }
+
+        do_accept(v4);
+        if (v6.is_open()) {
+            do_accept(v6);
+        }
+        thread = std::thread([this]() { ioc.run(); });
+    }
+
+    ~closing_listener() {
+        asio::post(ioc, [this]() {
+            asio::error_code ignore_ec;
+            v4.close(ignore_ec);
+            v6.close(ignore_ec);
+        });
+        thread.join();
+    }
+
+    inline uint16_t get_port() const { return port; }
+
+    inline bool has_ipv6() const { return v6.is_open(); }
+
+    // cpu seconds used by the accepting thread so far
+    double cpu_seconds() {
+        std::promise<double> cpu;
+        asio::post(ioc, [&cpu]() { cpu.set_value(thread_cpu_seconds()); });
+        return cpu.get_future().get();
+    }
+
+private:
+    void do_accept(asio::ip::tcp::acceptor& acceptor) {
+        acceptor.async_accept(
+            [this, &acceptor](std::error_code ec,
+                              asio::ip::tcp::socket /*socket*/) {
+                if (ec != asio::error::operation_aborted) {
+                    do_accept(acceptor);
+                }
+            });
+    }
+
+private:
+    asio::io_context ioc;
+    asio::ip::tcp::acceptor v4;
+    asio::ip::tcp::acceptor v6;
+    uint16_t port;
+    std::thread thread;
+};
+
+struct worker_result {
+    uint64_t handshakes = 0;
+    uint64_t failed = 0;
+    std::string error;
+    // nanoseconds from the TCP connect to the CONNECT reply
+    std::vector<uint64_t> latencies;
+    double cpu_seconds = 0;
+};
+
+void run_worker(const asio::ip::tcp::endpoint& proxy,
+                const std::string& username, const std::string& password,
+                const socks5_address& dst, uint64_t deadline,
+                worker_result& result) {
+    double cpu_start = thread_cpu_seconds();
+    asio::io_context ioc;
+    uint8_t buffer[64];
+    while (now_ns() < deadline) {
+        asio::ip::tcp::socket socket(ioc);
+        try {
+            uint64_t start = now_ns();
+            socket.connect(proxy);
+            socket.set_option(asio::ip::tcp::no_delay(true));
+            socks5_negotiate(socket, username, password);
+            socks5_request(socket, SocksV5::RequestCMD::Connect, dst);
+            result.latencies.push_back(now_ns() - start);
+            result.handshakes++;
+
+            // the proxy closes first, after the listener has closed
+            asio::error_code ec;
+            while (!ec) {
+                socket.read_some(asio::buffer(buffer), ec);
+            }
+        } catch (const std::exception& e) {
+            if (result.failed++ == 0) {
+                result.error = e.what();
+            }
+        }
+    }
+    result.cpu_seconds = thread_cpu_seconds() - cpu_start;
+}
+
+void run(const options& opts, const asio::ip::tcp::endpoint& proxy,
+         closing_listener& listener, bool password, const socks5_address& dst,
+         size_t concurrency) {
+    std::string username = password ? bench_username : "";
+    std::string passwd = password ? bench_password : "";
+    std::vector<worker_result> results(concurrency);
+    start_barrier barrier(concurrency + 1);
+    std::atomic<uint64_t> deadline(0);
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < concurrency; i++) {
+        workers.emplace_back([&, i]() {
+            barrier.arrive_and_wait();
+            run_worker(proxy, username, passwd, dst, deadline.load(),
+                       results[i]);
+        });
+    }
+
+    double cpu_start = process_cpu_seconds();
+    double listener_cpu_start = listener.cpu_seconds();
+    uint64_t start = now_ns();
+    deadline.store(start + opts.duration * 1000000000);
+    barrier.arrive_and_wait();
+    for (auto&& worker : workers) {
+        worker.join();
+    }
+    double seconds = (now_ns() - start) / 1e9;
+    double harness_cpu = listener.cpu_seconds() - listener_cpu_start;
+    double process_cpu = process_cpu_seconds() - cpu_start;
+
+    uint64_t handshakes = 0;
+    uint64_t failed = 0;
+    std::string error;
+    std::vector<uint64_t> latencies;
+    for (auto&& result : results) {
+        handshakes += result.handshakes;
+        failed += result.failed;
+        harness_cpu += result.cpu_seconds;
+        latencies.insert(latencies.end(), result.latencies.begin(),
+                         result.latencies.end());
+        if (error.empty()) {
+            error = result.error;
+        }
+    }
+
+    std::printf("%11zu %10.0f %12.1f %10.1f %10.1f", concurrency,
+                handshakes / seconds,
+                handshakes > 0 ? (process_cpu - harness_cpu) * 1e6 / handshakes
+                               : 0,
+                percentile(latencies, 0.5) / 1e3,
+                percentile(latencies, 0.99) / 1e3);
+    if (failed > 0) {
+        std::printf("  (%llu failed : %s)",
+                    static_cast<unsigned long long>(failed), error.c_str());
+    }
+    std::printf("\n");
+    std::fflush(stdout);
+}
+
+std::vector<std::string> parse_name_list(
+    const std::string& text, const std::vector<std::string>& valid) {
+    std::vector<std::string> names;
+    size_t begin = 0;
+    while (begin <= text.size()) {
+        size_t end = text.find(',', begin);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string name = text.substr(begin, end - begin);
+        if (std::find(valid.begin(), valid.end(), name) == valid.end()) {
+            throw std::invalid_argument("bad name list : " + text);
+        }
+        names.push_back(name);
+        begin = end + 1;
+    }
+    return names;
+}
+
+bool parse_options(int argc, char* argv[], options& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string name = argv[i];
+        std::string value = argv[i + 1];
+        if (name == "--auth") {
+            opts.auth = parse_name_list(value, {"none", "password"});
+        } else if (name == "--target") {
+            opts.targets =
+                parse_name_list(value, {"ipv4", "ipv6", "domain"});
+        } else if (name == "--concurrency") {
+            opts.concurrency = parse_size_list(value);
+        } else if (name == "--duration") {
+            opts.duration = parse_size_list(value).at(0);
+        } else if (name == "--threads") {
+            opts.threads = parse_size_list(value).at(0);
+        } else if (name == "--domain") {
+            opts.domain = value;
+        } else if (name == "--config") {
+            opts.config = load_json_file(value);
+        } else {
+            return false;
+        }
+    }
+    return argc % 2 == 1 && opts.threads > 0 && !opts.domain.empty() &&
+           opts.domain.size() <= 255;
+}
+
+}    // namespace
+
+int main(int argc, char* argv[]) {
+    options opts;
+    try {
+        if (!parse_options(argc, argv, opts)) {
+            std::fprintf(stderr,
+                         "usage : %s [--auth none,password] "
+                         "[--target ipv4,ipv6,domain] "
+                         "[--concurrency 1,8,64] [--duration 3] "
+                         "[--threads 1] [--domain localhost] "
+                         "[--config file.json]\n",
+                         argv[0]);
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    // both methods are offered, every client asks for one of them
+    nlohmann::json config = {
+        {"auth",
+         {{"username", bench_username}, {"password", bench_password}}},
+        {"supported-methods", {0, 2}},
+    };
+    config.merge_patch(opts.config);
+
+    try {
+        bench_proxy proxy(opts.threads, config);
+        closing_listener listener;
+
+        std::printf("%s\n", build_description().c_str());
+        std::printf("%zu s per run, %zu proxy threads\n", opts.duration,
+                    opts.threads);
+        for (auto&& auth : opts.auth) {
+            for (auto&& target : opts.targets) {
+                socks5_address dst;
+                if (target == "ipv4") {
+                    dst = socks5_address::from_ip(
+                        asio::ip::address_v4::loopback(), listener.get_port());
+                } else if (target == "ipv6") {
+                    if (!listener.has_ipv6()) {
+                        std::printf("\nno ::1, skipping ipv6\n");
+                        continue;
+                    }
+                    dst = socks5_address::from_ip(
+                        asio::ip::address_v6::loopback(), listener.get_port());
+                } else {
+                    dst = socks5_address::from_domain(opts.domain,
+                                                      listener.get_port());
+                }
+
+                std::printf("\nauth %s, target %s\n", auth.c_str(),
+                            target.c_str());
+                std::printf("%11s %10s %12s %10s %10s\n", "concurrency",
+                            "conn/s", "proxy cpu us", "p50 us", "p99 us");
+                for (size_t concurrency : opts.concurrency) {
+                    run(opts, proxy.get_endpoint(), listener,
+                        auth == "password", dst, concurrency);
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "socks5_client.h"
+
+socks5_address socks5_address::from_ip(const asio::ip::address& address,
+                                       uint16_t port) {
+    socks5_address dst;
+    if (address.is_v4()) {
+        auto&& bytes = address.to_v4().to_bytes();
+        dst.atyp = SocksV5::RequestATYP::Ipv4;
+        dst.address.assign(bytes.begin(), bytes.end());
+    } else {
+        auto&& bytes = address.to_v6().to_bytes();
+        dst.atyp = SocksV5::RequestATYP::Ipv6;
+        dst.address.assign(bytes.begin(), bytes.end());
+    }
+    dst.port = port;
+    return dst;
+}
+
+socks5_address socks5_address::from_domain(const std::string& name,
+                                           uint16_t port) {
+    socks5_address dst;
+    dst.atyp = SocksV5::RequestATYP::DoMainName;
+    dst.address.assign(name.begin(), name.end());
+    dst.port = port;
+    return dst;
+}
+
+void socks5_negotiate(asio::ip::tcp::socket& socket,
+                      const std::string& username,
+                      const std::string& password) {
+    SocksV5::Method method = username.empty() ? SocksV5::Method::NoAuth
+                                              : SocksV5::Method::UserPassWd;
+    uint8_t hello[] = {static_cast<uint8_t>(SocksVersion::V5), 1,
+                       static_cast<uint8_t>(method)};
+    asio::write(socket, asio::buffer(hello));
+
+    uint8_t selected[2];
+    asio::read(socket, asio::buffer(selected));
+    if (selected[1] != static_cast<uint8_t>(method)) {
+        throw std::runtime_error("the proxy refused the method");
+    }
+    if (method == SocksV5::Method::NoAuth) {
+        return;
+    }
+
+    std::vector<uint8_t> auth;
+    auth.push_back(0x01);
+    auth.push_back(static_cast<uint8_t>(username.size()));
+    auth.insert(auth.end(), username.begin(), username.end());
+    auth.push_back(static_cast<uint8_t>(password.size()));
+    auth.insert(auth.end(), password.begin(), password.end());
+    asio::write(socket, asio::buffer(auth));
+
+    uint8_t status[2];
+    asio::read(socket, asio::buffer(status));
+    if (status[1] != static_cast<uint8_t>(SocksV5::ReplyAuthStatus::Success)) {
+        throw std::runtime_error("the proxy refused the credentials");
+    }
+}
+
+asio::ip::tcp::endpoint socks5_request(asio::ip::tcp::socket& socket,
+                                       SocksV5::RequestCMD cmd,
+                                       const socks5_address& dst) {
+    std::vector<uint8_t> request = {static_cast<uint8_t>(SocksVersion::V5),
+                                    static_cast<uint8_t>(cmd), 0x00,
+                                    static_cast<uint8_t>(dst.atyp)};
+    if (dst.atyp == SocksV5::RequestATYP::DoMainName) {
+        request.push_back(static_cast<uint8_t>(dst.address.size()));
+    }
+    request.insert(request.end(), dst.address.begin(), dst.address.end());
+    request.push_back(static_cast<uint8_t>(dst.port >> 8));
+    request.push_back(static_cast<uint8_t>(dst.port & 0xff));
+    asio::write(socket, asio::buffer(request));
+
+    // VER REP RSV ATYP and the first byte of BND.ADDR
+    uint8_t reply[5];
+    asio::read(socket, asio::buffer(reply));
+    if (reply[1] != static_cast<uint8_t>(SocksV5::ReplyREP::Succeeded)) {
+        throw std::runtime_error("the proxy replied REP = " +
+                                 std::to_string(reply[1]));
+    }
+
+    uint8_t bnd[16 + 2];
+    asio::ip::tcp::endpoint endpoint;
+    switch (static_cast<SocksV5::ReplyATYP>(reply[3])) {
+        case SocksV5::ReplyATYP::Ipv4: {
+            asio::ip::address_v4::bytes_type bytes;
+            bytes[0] = reply[4];
+            asio::read(socket, asio::buffer(bnd, 3 + 2));
+            std::memcpy(bytes.data() + 1, bnd, 3);
+            endpoint.address(asio::ip::address_v4(bytes));
+            endpoint.port(static_cast<uint16_t>(bnd[3] << 8 | bnd[4]));
+            break;
+        }
+        case SocksV5::ReplyATYP::Ipv6: {
+            asio::ip::address_v6::bytes_type bytes;
+            bytes[0] = reply[4];
+            asio::read(socket, asio::buffer(bnd, 15 + 2));
+            std::memcpy(bytes.data() + 1, bnd, 15);
+            endpoint.address(asio::ip::address_v6(bytes));
+            endpoint.port(static_cast<uint16_t>(bnd[15] << 8 | bnd[16]));
+            break;
+        }
+        default:
+            throw std::runtime_error("the proxy replied ATYP = " +
+                                     std::to_string(reply[3]));
+    }
+    return endpoint;
+}
+
+size_t socks5_udp_header(const socks5_address& dst, uint8_t* out) {
+    uint8_t* p = out;
+    *p++ = 0x00;
+    *p++ = 0x00;
+    *p++ = 0x00;
+    *p++ = static_cast<uint8_t>(dst.atyp);
+    if (dst.atyp == SocksV5::RequestATYP::DoMainName) {
+        *p++ = static_cast<uint8_t>(dst.address.size());
+    }
+    std::memcpy(p, dst.address.data(), dst.address.size());
+    p += dst.address.size();
+    *p++ = static_cast<uint8_t>(dst.port >> 8);
+    *p++ = static_cast<uint8_t>(dst.port & 0xff);
+    return static_cast<size_t>(p - out);
+}
+
+size_t socks5_udp_header_length(const uint8_t* data, size_t length) {
+    if (length < 4 || data[2] != 0x00) {
+        return 0;
+    }
+
+    size_t header_length = 0;
+    switch (static_cast<SocksV5::ReplyATYP>(data[3])) {
+        case SocksV5::ReplyATYP::Ipv4:
+            header_length = 4 + 4 + 2;
+            break;
+        case SocksV5::ReplyATYP::Ipv6:
+            header_length = 4 + 16 + 2;
+            break;
+        case SocksV5::ReplyATYP::DoMainName:
+            if (length < 5) {
+                return 0;
+            }
+            header_length = 4 + 1 + data[4] + 2;
+            break;
+        default:
+            return 0;
+    }
+    return header_length <= length ? header_length : 0;
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "common/common.h"
+#include "common/socks5_type.h"
+
+// Blocking SOCKS5 client steps for the benchmarks. Socket errors throw
+// asio::system_error, a refusal by the proxy throws std::runtime_error.
+
+// DST.ADDR and DST.PORT as a request carries them
+struct socks5_address {
+    SocksV5::RequestATYP atyp;
+    // 4 or 16 bytes, or the domain name
+    std::vector<uint8_t> address;
+    uint16_t port;
+
+    static socks5_address from_ip(const asio::ip::address& address,
+                                  uint16_t port);
+
+    static socks5_address from_domain(const std::string& name, uint16_t port);
+};
+
+// offers username/password if username is not empty, no authentication
+// otherwise
+void socks5_negotiate(asio::ip::tcp::socket& socket,
+                      const std::string& username,
+                      const std::string& password);
+
+// sends the request and returns BND.ADDR and BND.PORT of the reply
+asio::ip::tcp::endpoint socks5_request(asio::ip::tcp::socket& socket,
+                                       SocksV5::RequestCMD cmd,
+                                       const socks5_address& dst);
+
+// RSV FRAG ATYP DST.ADDR DST.PORT of a datagram to dst written to out, which
+// must hold max_udp_header bytes, returns the length
+const size_t max_udp_header = 4 + 1 + 255 + 2;
+
+size_t socks5_udp_header(const socks5_address& dst, uint8_t* out);
+
+// length of the header a datagram from the proxy starts with, 0 if it has
+// none
+size_t socks5_udp_header_length(const uint8_t* data, size_t length);
\ No newline at end of file
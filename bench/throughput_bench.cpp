@@ -0,0 +1,343 @@
+// Relay throughput of the proxy on loopback. Every stream is a CONNECT
+// through the proxy to a local server, data flows for the given duration
+// and every chunk carries the time it was sent, so the receiver knows how
+// long the chunk took through the proxy.
+//
+//   throughput_bench [--mode upload|download|echo] [--streams 1,2,4,8]
+//                    [--duration 5] [--chunk 16384] [--threads 1]
+//                    [--config file.json]
+//
+// upload sends from the client to a sink, download from a source to the
+// client, echo sends a chunk and waits for it to come back before sending
+// the next one. --config is merged into the proxy configuration.
+//
+// The proxy, the servers and the clients share the machine, cpu is given
+// for the whole process and for the proxy alone, which is the process
+// minus the threads of the clients and the servers.
+
+#include <cinttypes>
+#include <cstdio>
+
+#include "bench_util.h"
+#include "socks5_client.h"
+
+namespace {
+
+enum class mode { upload, download, echo };
+
+struct options {
+    mode relay_mode = mode::upload;
+    std::vector<size_t> streams = {1, 2, 4, 8};
+    size_t duration = 5;
+    size_t chunk = 16384;
+    size_t threads = 1;
+    nlohmann::json config = nlohmann::json::object();
+};
+
+// what one side of a stream measured
+struct stream_result {
+    // received, chunks not yet complete at the end included
+    uint64_t bytes = 0;
+    // nanoseconds from sending a chunk to receiving it
+    std::vector<uint64_t> latencies;
+    double cpu_seconds = 0;
+};
+
+// results of the client threads and of the server connections
+class result_collector {
+public:
+    void add(stream_result&& result) {
+        std::lock_guard<std::mutex> lock(mutex);
+        results.push_back(std::move(result));
+    }
+
+    std::vector<stream_result> take() {
+        std::vector<stream_result> taken;
+        std::lock_guard<std::mutex> lock(mutex);
+        taken.swap(results);
+        return taken;
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<stream_result> results;
+};
+
+void write_u64(uint8_t* out, uint64_t value) {
+    std::memcpy(out, &value, sizeof(value));
+}
+
+uint64_t read_u64(const uint8_t* in) {
+    uint64_t value;
+    std::memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+// chunks stamped with their send time until deadline
+void send_chunks(asio::ip::tcp::socket& socket, size_t chunk,
+                 uint64_t deadline) {
+    std::vector<uint8_t> buffer(chunk, 0x5a);
+    asio::error_code ec;
+    for (uint64_t now = now_ns(); now < deadline && !ec; now = now_ns()) {
+        write_u64(buffer.data(), now);
+        asio::write(socket, asio::buffer(buffer), ec);
+    }
+    socket.shutdown(asio::ip::tcp::socket::shutdown_send, ec);
+}
+
+void receive_chunks(asio::ip::tcp::socket& socket, size_t chunk,
+                    stream_result& result) {
+    std::vector<uint8_t> buffer(chunk);
+    asio::error_code ec;
+    while (!ec) {
+        size_t n = asio::read(socket, asio::buffer(buffer), ec);
+        result.bytes += n;
+        if (n == chunk) {
+            result.latencies.push_back(now_ns() - read_u64(buffer.data()));
+        }
+    }
+}
+
+// reads until the peer closes
+void drain(asio::ip::tcp::socket& socket) {
+    uint8_t buffer[4096];
+    asio::error_code ec;
+    while (!ec) {
+        socket.read_some(asio::buffer(buffer), ec);
+    }
+}
+
+// Servers add their result before they stop writing, a client that has
+// read to the end of its stream knows the server side is in.
+loopback_server::handler_type server_handler(const options& opts,
+                                             result_collector& results) {
+    size_t chunk = opts.chunk;
+    switch (opts.relay_mode) {
+        case mode::upload:
+            return [chunk, &results](asio::ip::tcp::socket& socket) {
+                stream_result result;
+                receive_chunks(socket, chunk, result);
+                result.cpu_seconds = thread_cpu_seconds();
+                results.add(std::move(result));
+            };
+        case mode::download:
+            // the client sends the deadline when the measurement starts
+            return [chunk, &results](asio::ip::tcp::socket& socket) {
+                uint8_t deadline[8];
+                asio::error_code ec;
+                asio::read(socket, asio::buffer(deadline), ec);
+                if (!ec) {
+                    send_chunks(socket, chunk, read_u64(deadline));
+                }
+                stream_result result;
+                result.cpu_seconds = thread_cpu_seconds();
+                results.add(std::move(result));
+                drain(socket);
+            };
+        default:
+            return [&results](asio::ip::tcp::socket& socket) {
+                uint8_t buffer[65536];
+                asio::error_code ec;
+                while (!ec) {
+                    size_t n = socket.read_some(asio::buffer(buffer), ec);
+                    if (!ec) {
+                        asio::write(socket, asio::buffer(buffer, n), ec);
+                    }
+                }
+                stream_result result;
+                result.cpu_seconds = thread_cpu_seconds();
+                results.add(std::move(result));
+            };
+    }
+}
+
+void run_client(const options& opts, asio::ip::tcp::socket& socket,
+                uint64_t deadline, result_collector& results) {
+    double cpu_start = thread_cpu_seconds();
+    stream_result result;
+    asio::error_code ec;
+    switch (opts.relay_mode) {
+        case mode::upload:
+            send_chunks(socket, opts.chunk, deadline);
+            drain(socket);
+            break;
+        case mode::download: {
+            uint8_t buffer[8];
+            write_u64(buffer, deadline);
+            asio::write(socket, asio::buffer(buffer), ec);
+            receive_chunks(socket, opts.chunk, result);
+            break;
+        }
+        case mode::echo: {
+            std::vector<uint8_t> buffer(opts.chunk, 0x5a);
+            for (uint64_t now = now_ns(); now < deadline; now = now_ns()) {
+                write_u64(buffer.data(), now);
+                asio::write(socket, asio::buffer(buffer), ec);
+                if (ec) {
+                    break;
+                }
+                result.bytes += asio::read(socket, asio::buffer(buffer), ec);
+                if (ec) {
+                    break;
+                }
+                result.latencies.push_back(now_ns() - now);
+            }
+            socket.shutdown(asio::ip::tcp::socket::shutdown_send, ec);
+            drain(socket);
+            break;
+        }
+    }
+    result.cpu_seconds = thread_cpu_seconds() - cpu_start;
+    results.add(std::move(result));
+}
+
+void run(const options& opts, const asio::ip::tcp::endpoint& proxy,
+         const asio::ip::tcp::endpoint& server, result_collector& results,
+         size_t streams) {
+    start_barrier barrier(streams + 1);
+    std::atomic<uint64_t> deadline(0);
+    std::atomic<size_t> failed(0);
+
+    std::vector<std::thread> clients;
+    for (size_t i = 0; i < streams; i++) {
+        clients.emplace_back([&]() {
+            asio::io_context ioc;
+            asio::ip::tcp::socket socket(ioc);
+            bool ready = false;
+            try {
+                socket.connect(proxy);
+                socket.set_option(asio::ip::tcp::no_delay(true));
+                socks5_negotiate(socket, "", "");
+                socks5_request(
+                    socket, SocksV5::RequestCMD::Connect,
+                    socks5_address::from_ip(server.address(), server.port()));
+                ready = true;
+            } catch (const std::exception& e) {
+                std::fprintf(stderr, "stream failed : %s\n", e.what());
+                failed++;
+            }
+            barrier.arrive_and_wait();
+            if (ready) {
+                run_client(opts, socket, deadline.load(), results);
+            }
+        });
+    }
+
+    // streams are set up before the measurement starts
+    double cpu_start = process_cpu_seconds();
+    uint64_t start = now_ns();
+    deadline.store(start + opts.duration * 1000000000);
+    barrier.arrive_and_wait();
+    for (auto&& client : clients) {
+        client.join();
+    }
+    double seconds = (now_ns() - start) / 1e9;
+    double process_cpu = process_cpu_seconds() - cpu_start;
+
+    uint64_t bytes = 0;
+    double harness_cpu = 0;
+    std::vector<uint64_t> latencies;
+    for (auto&& result : results.take()) {
+        bytes += result.bytes;
+        harness_cpu += result.cpu_seconds;
+        latencies.insert(latencies.end(), result.latencies.begin(),
+                         result.latencies.end());
+    }
+
+    double gigabytes = bytes / 1e9;
+    std::printf("%7zu %9.3f %12.3f %12.3f %10.1f %10.1f", streams,
+                gigabytes * 8 / seconds,
+                gigabytes > 0 ? (process_cpu - harness_cpu) / gigabytes : 0,
+                gigabytes > 0 ? process_cpu / gigabytes : 0,
+                percentile(latencies, 0.5) / 1e3,
+                percentile(latencies, 0.99) / 1e3);
+    if (failed > 0) {
+        std::printf("  (%zu streams failed)", failed.load());
+    }
+    std::printf("\n");
+    std::fflush(stdout);
+}
+
+const char* mode_name(mode m) {
+    switch (m) {
+        case mode::upload:
+            return "upload";
+        case mode::download:
+            return "download";
+        default:
+            return "echo";
+    }
+}
+
+bool parse_options(int argc, char* argv[], options& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string name = argv[i];
+        std::string value = argv[i + 1];
+        if (name == "--mode") {
+            if (value == "upload") {
+                opts.relay_mode = mode::upload;
+            } else if (value == "download") {
+                opts.relay_mode = mode::download;
+            } else if (value == "echo") {
+                opts.relay_mode = mode::echo;
+            } else {
+                return false;
+            }
+        } else if (name == "--streams") {
+            opts.streams = parse_size_list(value);
+        } else if (name == "--duration") {
+            opts.duration = parse_size_list(value).at(0);
+        } else if (name == "--chunk") {
+            opts.chunk = parse_size_list(value).at(0);
+        } else if (name == "--threads") {
+            opts.threads = parse_size_list(value).at(0);
+        } else if (name == "--config") {
+            opts.config = load_json_file(value);
+        } else {
+            return false;
+        }
+    }
+    // the chunk carries its send time
+    return argc % 2 == 1 && opts.chunk >= 8 && opts.threads > 0;
+}
+
+}    // namespace
+
+int main(int argc, char* argv[]) {
+    options opts;
+    try {
+        if (!parse_options(argc, argv, opts)) {
+            std::fprintf(stderr,
+                         "usage : %s [--mode upload|download|echo] "
+                         "[--streams 1,2,4,8] [--duration 5] [--chunk 16384] "
+                         "[--threads 1] [--config file.json]\n",
+                         argv[0]);
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    try {
+        bench_proxy proxy(opts.threads, opts.config);
+        result_collector results;
+        loopback_server server(asio::ip::address_v4::loopback(),
+                               server_handler(opts, results));
+
+        std::printf("%s\n", build_description().c_str());
+        std::printf("mode %s, chunk %zu B, %zu s per run, %zu proxy threads\n",
+                    mode_name(opts.relay_mode), opts.chunk, opts.duration,
+                    opts.threads);
+        std::printf("%7s %9s %12s %12s %10s %10s\n", "streams", "Gbit/s",
+                    "proxy cpu/GB", "total cpu/GB", "p50 us", "p99 us");
+        for (size_t streams : opts.streams) {
+            run(opts, proxy.get_endpoint(), server.get_endpoint(), results,
+                streams);
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,429 @@
+// UDP ASSOCIATE packet rate of the proxy on loopback. Every association is
+// a client thread that keeps a window of datagrams in flight through the
+// proxy to a local UDP echo server. A datagram carries its sequence number
+// and send time, a datagram not echoed within the loss timeout is counted
+// as lost and replaced by a new one.
+//
+//   udp_bench [--target ipv4,ipv6,domain] [--size 64,512,1400]
+//             [--associations 1,16] [--window 8] [--duration 3]
+//             [--threads 1] [--domain localhost] [--config file.json]
+//
+// --size is the payload after the SOCKS5 header. domain datagrams are
+// resolved by the proxy one by one through the system resolver, the name
+// should be in the hosts file so that no DNS server is involved. ipv6
+// datagrams come from associations of an IPv6 client on ::1, the others
+// from 127.0.0.1; when ipv6 is measured the proxy listens on :: for both.
+// The echo server listens on 127.0.0.1 and ::1 with the same port.
+//
+// Cpu of the proxy is the process minus the client and echo threads.
+
+#include <poll.h>
+
+#include <algorithm>
+#include <cstdio>
+
+#include "bench_util.h"
+#include "socks5_client.h"
+
+namespace {
+
+const int loss_timeout_ms = 100;
+
+// sequence number and send time
+const size_t stamp_size = 16;
+
+struct options {
+    std::vector<std::string> targets = {"ipv4", "ipv6", "domain"};
+    std::vector<size_t> sizes = {64, 512, 1400};
+    std::vector<size_t> associations = {1, 16};
+    size_t window = 8;
+    size_t duration = 3;
+    size_t threads = 1;
+    std::string domain = "localhost";
+    nlohmann::json config = nlohmann::json::object();
+};
+
+void write_u64(uint8_t* out, uint64_t value) {
+    std::memcpy(out, &value, sizeof(value));
+}
+
+uint64_t read_u64(const uint8_t* in) {
+    uint64_t value;
+    std::memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+// Echoes datagrams on 127.0.0.1 and, if it can, on ::1 with the same port.
+// The destructor stops it with an empty datagram to each socket.
+class udp_echo_server : public noncopyable {
+public:
+    udp_echo_server()
+        : v4(ioc, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(),
+                                          0)),
+          v6(ioc),
+          port(v4.local_endpoint().port()),
+          cpu_seconds(0) {
+        asio::error_code ec;
+        v6.open(asio::ip::udp::v6(), ec);
+        if (!ec) {
+            v6.set_option(asio::ip::v6_only(true), ec);
+            v6.bind(asio::ip::udp::endpoint(asio::ip::address_v6::loopback(),
+                                            port),
+                    ec);
+        }
+        if (ec) {
+            v6.close(ec);
+        }
+
+        threads.emplace_back(&udp_echo_server::run, this, std::ref(v4));
+        if (v6.is_open()) {
+            threads.emplace_back(&udp_echo_server::run, this, std::ref(v6));
+        }
+    }
+
+    ~udp_echo_server() { stop(); }
+
+    // returns the cpu seconds used by the echo threads
+    double stop() {
+        asio::error_code ignore_ec;
+        for (auto* socket : {&v4, &v6}) {
+            if (socket->is_open()) {
+                socket->send_to(asio::const_buffer(),
+                                socket->local_endpoint(), 0, ignore_ec);
+            }
+        }
+        for (auto&& thread : threads) {
+            thread.join();
+        }
+        threads.clear();
+        return cpu_seconds;
+    }
+
+    inline uint16_t get_port() const { return port; }
+
+    inline bool has_ipv6() const { return v6.is_open(); }
+
+private:
+    void run(asio::ip::udp::socket& socket) {
+        std::vector<uint8_t> buffer(65536);
+        asio::ip::udp::endpoint sender;
+        asio::error_code ec;
+        for (;;) {
+            size_t n = socket.receive_from(asio::buffer(buffer), sender, 0, ec);
+            if (!ec && n == 0) {
+                break;
+            }
+            if (!ec) {
+                socket.send_to(asio::buffer(buffer.data(), n), sender, 0, ec);
+            }
+        }
+
+        double cpu = thread_cpu_seconds();
+        std::lock_guard<std::mutex> lock(mutex);
+        cpu_seconds += cpu;
+    }
+
+private:
+    asio::io_context ioc;
+    asio::ip::udp::socket v4;
+    asio::ip::udp::socket v6;
+    uint16_t port;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    double cpu_seconds;
+};
+
+struct association_result {
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    // nanoseconds from sending a datagram to receiving its echo
+    std::vector<uint64_t> latencies;
+    double cpu_seconds = 0;
+};
+
+// The TCP connection of an association and its UDP socket, set up before
+// the measurement starts.
+struct association {
+    explicit association(asio::io_context& ioc) : control(ioc), udp(ioc) {}
+
+    // an IPv6 client connects and sends from ::1, an IPv4 client from the
+    // proxy address
+    void open(const asio::ip::tcp::endpoint& proxy, bool ipv6) {
+        asio::ip::address client =
+            ipv6 ? asio::ip::address(asio::ip::address_v6::loopback())
+                 : proxy.address();
+
+        control.connect(asio::ip::tcp::endpoint(client, proxy.port()));
+        socks5_negotiate(control, "", "");
+        // any sender on the client host becomes the client
+        asio::ip::tcp::endpoint bnd = socks5_request(
+            control, SocksV5::RequestCMD::UdpAssociate,
+            socks5_address::from_ip(
+                ipv6 ? asio::ip::address(asio::ip::address_v6::any())
+                     : asio::ip::address(asio::ip::address_v4::any()),
+                0));
+        relay = asio::ip::udp::endpoint(
+            bnd.address().is_unspecified() ? client : bnd.address(),
+            bnd.port());
+
+        udp.open(relay.protocol());
+        udp.bind(asio::ip::udp::endpoint(client, 0));
+        udp.non_blocking(true);
+    }
+
+    asio::ip::tcp::socket control;
+    asio::ip::udp::socket udp;
+    asio::ip::udp::endpoint relay;
+};
+
+// waits up to timeout_ms for a datagram, false if none came
+bool wait_readable(asio::ip::udp::socket& socket, int timeout_ms) {
+    struct pollfd fd = {socket.native_handle(), POLLIN, 0};
+    return ::poll(&fd, 1, timeout_ms) > 0;
+}
+
+void run_association(association& assoc, const socks5_address& dst,
+                     size_t size, size_t window, uint64_t deadline,
+                     association_result& result) {
+    double cpu_start = thread_cpu_seconds();
+    std::vector<uint8_t> datagram(max_udp_header + size, 0x5a);
+    size_t header_length = socks5_udp_header(dst, datagram.data());
+    datagram.resize(header_length + size);
+    std::vector<uint8_t> buffer(65536);
+
+    // datagrams sent before the oldest one still awaited are late echoes
+    // of datagrams already counted as lost
+    uint64_t awaited = 0;
+    asio::error_code ec;
+    for (;;) {
+        uint64_t now = now_ns();
+        bool sending = now < deadline;
+        while (sending && result.sent - awaited < window) {
+            write_u64(datagram.data() + header_length, result.sent);
+            write_u64(datagram.data() + header_length + 8, now_ns());
+            assoc.udp.send_to(asio::buffer(datagram), assoc.relay, 0, ec);
+            result.sent++;
+        }
+        if (awaited == result.sent) {
+            break;
+        }
+
+        if (!wait_readable(assoc.udp, loss_timeout_ms)) {
+            awaited = result.sent;
+            continue;
+        }
+        asio::ip::udp::endpoint sender;
+        for (;;) {
+            size_t n = assoc.udp.receive_from(asio::buffer(buffer), sender, 0,
+                                              ec);
+            if (ec) {
+                break;
+            }
+            size_t offset = socks5_udp_header_length(buffer.data(), n);
+            if (offset == 0 || n - offset < stamp_size) {
+                continue;
+            }
+            uint64_t seq = read_u64(buffer.data() + offset);
+            if (seq < awaited) {
+                continue;
+            }
+            result.latencies.push_back(now_ns() -
+                                       read_u64(buffer.data() + offset + 8));
+            result.received++;
+            awaited = std::max(awaited, seq + 1);
+        }
+    }
+    result.cpu_seconds = thread_cpu_seconds() - cpu_start;
+}
+
+void run(const options& opts, const asio::ip::tcp::endpoint& proxy,
+         const std::string& target, size_t size, size_t count) {
+    udp_echo_server echo;
+    socks5_address dst;
+    if (target == "ipv4") {
+        dst = socks5_address::from_ip(asio::ip::address_v4::loopback(),
+                                      echo.get_port());
+    } else if (target == "ipv6") {
+        dst = socks5_address::from_ip(asio::ip::address_v6::loopback(),
+                                      echo.get_port());
+    } else {
+        dst = socks5_address::from_domain(opts.domain, echo.get_port());
+    }
+
+    std::vector<association_result> results(count);
+    start_barrier barrier(count + 1);
+    std::atomic<uint64_t> deadline(0);
+    std::atomic<size_t> failed(0);
+
+    std::vector<std::thread> clients;
+    for (size_t i = 0; i < count; i++) {
+        clients.emplace_back([&, i]() {
+            asio::io_context ioc;
+            association assoc(ioc);
+            bool ready = false;
+            try {
+                assoc.open(proxy, target == "ipv6");
+                ready = true;
+            } catch (const std::exception& e) {
+                std::fprintf(stderr, "association failed : %s\n", e.what());
+                failed++;
+            }
+            barrier.arrive_and_wait();
+            if (ready) {
+                run_association(assoc, dst, size, opts.window,
+                                deadline.load(), results[i]);
+            }
+        });
+    }
+
+    double cpu_start = process_cpu_seconds();
+    uint64_t start = now_ns();
+    deadline.store(start + opts.duration * 1000000000);
+    barrier.arrive_and_wait();
+    for (auto&& client : clients) {
+        client.join();
+    }
+    double seconds = (now_ns() - start) / 1e9;
+    double harness_cpu = echo.stop();
+    double process_cpu = process_cpu_seconds() - cpu_start;
+
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    std::vector<uint64_t> latencies;
+    for (auto&& result : results) {
+        sent += result.sent;
+        received += result.received;
+        harness_cpu += result.cpu_seconds;
+        latencies.insert(latencies.end(), result.latencies.begin(),
+                         result.latencies.end());
+    }
+
+    std::printf("%12zu %10.0f %7.2f %12.2f %9.1f %9.1f %9.1f", count,
+                received / seconds,
+                sent > 0 ? 100.0 * (sent - received) / sent : 0,
+                received > 0 ? (process_cpu - harness_cpu) * 1e6 / received
+                             : 0,
+                percentile(latencies, 0.5) / 1e3,
+                percentile(latencies, 0.99) / 1e3,
+                percentile(latencies, 0.999) / 1e3);
+    if (failed > 0) {
+        std::printf("  (%zu associations failed)", failed.load());
+    }
+    std::printf("\n");
+    std::fflush(stdout);
+}
+
+std::vector<std::string> parse_name_list(
+    const std::string& text, const std::vector<std::string>& valid) {
+    std::vector<std::string> names;
+    size_t begin = 0;
+    while (begin <= text.size()) {
+        size_t end = text.find(',', begin);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string name = text.substr(begin, end - begin);
+        if (std::find(valid.begin(), valid.end(), name) == valid.end()) {
+            throw std::invalid_argument("bad name list : " + text);
+        }
+        names.push_back(name);
+        begin = end + 1;
+    }
+    return names;
+}
+
+bool parse_options(int argc, char* argv[], options& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string name = argv[i];
+        std::string value = argv[i + 1];
+        if (name == "--target") {
+            opts.targets =
+                parse_name_list(value, {"ipv4", "ipv6", "domain"});
+        } else if (name == "--size") {
+            opts.sizes = parse_size_list(value);
+        } else if (name == "--associations") {
+            opts.associations = parse_size_list(value);
+        } else if (name == "--window") {
+            opts.window = parse_size_list(value).at(0);
+        } else if (name == "--duration") {
+            opts.duration = parse_size_list(value).at(0);
+        } else if (name == "--threads") {
+            opts.threads = parse_size_list(value).at(0);
+        } else if (name == "--domain") {
+            opts.domain = value;
+        } else if (name == "--config") {
+            opts.config = load_json_file(value);
+        } else {
+            return false;
+        }
+    }
+    for (size_t size : opts.sizes) {
+        if (size < stamp_size || size > 65000) {
+            return false;
+        }
+    }
+    return argc % 2 == 1 && opts.window > 0 && opts.threads > 0 &&
+           !opts.domain.empty() && opts.domain.size() <= 255;
+}
+
+}    // namespace
+
+int main(int argc, char* argv[]) {
+    options opts;
+    try {
+        if (!parse_options(argc, argv, opts)) {
+            std::fprintf(stderr,
+                         "usage : %s [--target ipv4,ipv6,domain] "
+                         "[--size 64,512,1400] [--associations 1,16] "
+                         "[--window 8] [--duration 3] [--threads 1] "
+                         "[--domain localhost] [--config file.json]\n",
+                         argv[0]);
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    // a dual stack listener takes the control connections of both families
+    bool ipv6 = std::find(opts.targets.begin(), opts.targets.end(),
+                          "ipv6") != opts.targets.end() &&
+                udp_echo_server().has_ipv6();
+    nlohmann::json config = nlohmann::json::object();
+    if (ipv6) {
+        config = {{"server", {{"host", "::"}}}};
+    }
+    config.merge_patch(opts.config);
+
+    try {
+        bench_proxy proxy(opts.threads, config);
+        ipv6 = ipv6 &&
+               asio::ip::make_address(ServerParser::global_config()->get_host())
+                   .is_v6();
+
+        std::printf("%s\n", build_description().c_str());
+        std::printf("%zu s per run, window %zu, %zu proxy threads\n",
+                    opts.duration, opts.window, opts.threads);
+        for (auto&& target : opts.targets) {
+            if (target == "ipv6" && !ipv6) {
+                std::printf("\nno ::1 or no IPv6 listener, skipping ipv6\n");
+                continue;
+            }
+            for (size_t size : opts.sizes) {
+                std::printf("\ntarget %s, %zu B payload\n", target.c_str(),
+                            size);
+                std::printf("%12s %10s %7s %12s %9s %9s %9s\n",
+                            "associations", "packets/s", "loss %",
+                            "proxy cpu us", "p50 us", "p99 us", "p99.9 us");
+                for (size_t count : opts.associations) {
+                    run(opts, proxy.get_endpoint(), target, size, count);
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
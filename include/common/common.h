@@ -11,6 +11,7 @@
 
 #include "asio.hpp"
 #include "logger.h"
+#include "util/endpoint_text.h"
 
 /* SOCKS Protocol Version Field */
 enum class SocksVersion : uint8_t {
@@ -37,12 +38,9 @@ namespace convert {
 template <typename InternetProtocol>
 std::string format_address(
     const asio::ip::basic_endpoint<InternetProtocol>& endpoint) {
-    if (endpoint.address().is_v6()) {
-        return "[" + endpoint.address().to_string() + "]" + ":" +
-               std::to_string(endpoint.port());
-    }
-    return endpoint.address().to_string() + ":" +
-           std::to_string(endpoint.port());
+    char text[max_endpoint_text];
+    return std::string(
+        text, write_endpoint_text(endpoint.address(), endpoint.port(), text));
 }
 
 std::string dst_to_string(const std::vector<uint8_t>& dst_addr, ATyp addr_type);
@@ -1,17 +1,56 @@
 #pragma once
 
-#include "spdlog/async.h"
+#include <atomic>
+#include <mutex>
+
+#include "asio.hpp"
 #include "spdlog/sinks/basic_file_sink.h"
 #include "spdlog/sinks/rotating_file_sink.h"
 #include "spdlog/sinks/stdout_color_sinks.h"
 #include "spdlog/spdlog.h"
+#include "util/log_queue_sink.h"
 
 class Logger {
 public:
     static Logger* getInstance();
 
+    // queue_size messages are buffered per logging thread, further messages
+    // are dropped until the background thread catches up
     bool Init(const std::string& log_file, long unsigned max_rotateSize,
-              long unsigned max_rotateCount);
+              long unsigned max_rotateCount, size_t queue_size);
+
+    // messages dropped because a queue was full
+    uint64_t GetDroppedMessages() const;
+
+    // Statements below the runtime level are skipped before their arguments
+    // are evaluated. Traced sessions log every level compiled in.
+    static inline bool ShouldLog(spdlog::level::level_enum level,
+                                 bool traced = false) {
+        return level >= runtime_level.load(std::memory_order_relaxed) ||
+               (traced && level >= SPDLOG_ACTIVE_LEVEL);
+    }
+
+    // the runtime level of a build without a configured level
+    static spdlog::level::level_enum DefaultLevel();
+
+    static void SetLevel(spdlog::level::level_enum level);
+
+    static inline spdlog::level::level_enum GetLevel() {
+        return static_cast<spdlog::level::level_enum>(
+            runtime_level.load(std::memory_order_relaxed));
+    }
+
+    // Sessions from client and authenticated as user are traced, an empty
+    // string matches any client or user and two empty strings trace none.
+    // false if client is not an ip address.
+    bool SetDebugScope(const std::string& client, const std::string& user);
+
+    void GetDebugScope(std::string& client, std::string& user) const;
+
+    // whether a session from address is traced, user is nullptr until the
+    // session has authenticated
+    bool InDebugScope(const asio::ip::address& address, const uint8_t* user,
+                      size_t ulen) const;
 
 private:
     Logger() = default;
@@ -20,4 +59,51 @@ private:
     Logger& operator=(const Logger&) = delete;
     Logger(Logger&&) = delete;
     Logger& operator=(Logger&&) = delete;
-};
\ No newline at end of file
+
+    // owned by the default logger, gone after spdlog::shutdown
+    std::weak_ptr<log_queue_sink> queue_sink;
+
+    static std::atomic<int> runtime_level;
+
+    // sessions check the flag before taking the mutex
+    std::atomic<bool> scoped{false};
+    mutable std::mutex scope_mutex;
+    std::string scope_client;
+    asio::ip::address scope_address;
+    std::string scope_user;
+};
+
+// Every SPDLOG_ statement checks the runtime level before its arguments are
+// evaluated, so disabled statements compiled in cost one relaxed load.
+#undef SPDLOG_LOGGER_CALL
+#define SPDLOG_LOGGER_CALL(logger, level, ...)                               \
+    do {                                                                     \
+        if (Logger::ShouldLog(level)) {                                      \
+            (logger)->log(                                                   \
+                spdlog::source_loc{__FILE__, __LINE__, SPDLOG_FUNCTION},     \
+                level, __VA_ARGS__);                                         \
+        }                                                                    \
+    } while (0)
+
+// DEBUG and TRACE statements of a session, also logged when the session is
+// in the debug scope. The enclosing class has a log_traced member.
+#define SOCKS_SESSION_LOG(level, ...)                                        \
+    do {                                                                     \
+        if (Logger::ShouldLog(level, this->log_traced)) {                    \
+            spdlog::default_logger_raw()->log(                               \
+                spdlog::source_loc{__FILE__, __LINE__, SPDLOG_FUNCTION},     \
+                level, __VA_ARGS__);                                         \
+        }                                                                    \
+    } while (0)
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_TRACE
+#define SESSION_TRACE(...) SOCKS_SESSION_LOG(spdlog::level::trace, __VA_ARGS__)
+#else
+#define SESSION_TRACE(...) (void)0
+#endif
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_DEBUG
+#define SESSION_DEBUG(...) SOCKS_SESSION_LOG(spdlog::level::debug, __VA_ARGS__)
+#else
+#define SESSION_DEBUG(...) (void)0
+#endif
\ No newline at end of file
@@ -1,16 +1,36 @@
 #pragma once
 
+#include <atomic>
+
 #include "common/common.h"
 #include "common/socks5_type.h"
+#include "util/credential_store.h"
+#include "util/socket_options.h"
 
+// A configuration snapshot. Snapshots are immutable once published, so the
+// current one is read through an atomic pointer without locking. A reload
+// publishes a new snapshot and the replaced one is kept until no thread can
+// still be reading it.
 class ServerParser {
 public:
-    static ServerParser* global_config() {
-        static ServerParser parser;
-        return &parser;
+    static const ServerParser* global_config() {
+        return current.load(std::memory_order_acquire);
     }
 
-    bool parse_config_file(const std::string& config_file);
+    // nullptr if the file is not a valid configuration
+    static std::unique_ptr<ServerParser> load_config_file(
+        const std::string& config_file);
+
+    // makes config the current snapshot and returns the replaced one
+    static std::unique_ptr<const ServerParser> publish(
+        std::unique_ptr<const ServerParser> config);
+
+    ~ServerParser() = default;
+
+    inline std::string get_config_file() const { return config_file; }
+
+    // distinct for every loaded snapshot
+    inline uint64_t get_generation() const { return generation; }
 
     inline std::string get_host() const { return host; }
 
@@ -18,6 +38,53 @@ public:
 
     inline size_t get_thread_num() const { return thread_num; }
 
+    inline size_t get_udp_relay_sockets() const { return udp_relay_sockets; }
+
+    inline size_t get_session_pool_size() const { return session_pool_size; }
+
+    inline bool get_shared_relay_buffers() const {
+        return shared_relay_buffers;
+    }
+
+    inline size_t get_relay_buffer_size() const { return relay_buffer_size; }
+
+    inline size_t get_zerocopy_threshold() const { return zerocopy_threshold; }
+
+    inline size_t get_connect_reply_delay() const {
+        return connect_reply_delay;
+    }
+
+    inline const socket_options& get_listener_socket_options() const {
+        return listener_socket_options;
+    }
+
+    inline int get_listen_backlog() const { return listen_backlog; }
+
+    inline const socket_options& get_client_socket_options() const {
+        return client_socket_options;
+    }
+
+    inline const socket_options& get_upstream_socket_options() const {
+        return upstream_socket_options;
+    }
+
+    inline std::string get_metrics_host() const { return metrics_host; }
+
+    // 0 if the metrics endpoint is disabled
+    inline uint16_t get_metrics_port() const { return metrics_port; }
+
+    // empty if the access log is disabled
+    inline std::string get_access_log_file() const { return access_log_file; }
+
+    inline size_t get_access_log_queue_size() const {
+        return access_log_queue_size;
+    }
+
+    // milliseconds
+    inline size_t get_access_log_flush_interval() const {
+        return access_log_flush_interval;
+    }
+
     inline std::string get_log_file() const { return log_file; }
 
     inline long unsigned get_max_rotate_size() const { return max_rotate_size; }
@@ -26,34 +93,74 @@ public:
         return max_rotate_count;
     }
 
+    // messages buffered per logging thread
+    inline size_t get_log_queue_size() const { return log_queue_size; }
+
+    inline spdlog::level::level_enum get_log_level() const {
+        return log_level;
+    }
+
+    // sessions logged at every level compiled in, empty for any
+    inline std::string get_log_debug_client() const {
+        return log_debug_client;
+    }
+
+    inline std::string get_log_debug_user() const { return log_debug_user; }
+
     inline size_t get_conn_timeout() const { return conn_timeout; }
 
     inline bool is_supported_method(SocksV5::Method method) const {
         return supported_methods.count(method) > 0;
     }
 
-    inline bool check_username(const std::string& uname) const {
-        return username == uname;
-    }
+    inline size_t get_auth_cache_size() const { return auth_cache_size; }
 
-    inline bool check_password(const std::string& passwd) const {
-        return password == passwd;
+    inline size_t get_auth_cache_ttl() const { return auth_cache_ttl; }
+
+    inline bool check_credentials(const uint8_t* uname, size_t ulen,
+                                  const uint8_t* passwd, size_t plen) const {
+        return credentials.verify(uname, ulen, passwd, plen);
     }
 
 private:
     explicit ServerParser();
-    ~ServerParser() = default;
+
+    bool parse_config_file(const std::string& config_file);
 
 private:
+    static std::atomic<const ServerParser*> current;
+
+    std::string config_file;
+    uint64_t generation;
     std::string host;
     uint16_t port;
     size_t thread_num;
+    size_t udp_relay_sockets;
+    size_t session_pool_size;
+    bool shared_relay_buffers;
+    size_t relay_buffer_size;
+    size_t zerocopy_threshold;
+    size_t connect_reply_delay;
     size_t conn_timeout;
+    socket_options listener_socket_options;
+    int listen_backlog;
+    socket_options client_socket_options;
+    socket_options upstream_socket_options;
+    std::string metrics_host;
+    uint16_t metrics_port;
+    std::string access_log_file;
+    size_t access_log_queue_size;
+    size_t access_log_flush_interval;
     std::string log_file;
     long unsigned max_rotate_size;
     long unsigned max_rotate_count;
-    std::string username;
-    std::string password;
+    size_t log_queue_size;
+    spdlog::level::level_enum log_level;
+    std::string log_debug_client;
+    std::string log_debug_user;
+    credential_store credentials;
+    size_t auth_cache_size;
+    size_t auth_cache_ttl;
     std::unordered_set<SocksV5::Method, SocksV5::MethodHash,
                        SocksV5::MethodEqual>
         supported_methods;
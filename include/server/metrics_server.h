@@ -0,0 +1,38 @@
+#pragma once
+
+#include "common/common.h"
+#include "util/io_context_pool.h"
+
+// Serves the metrics of all workers in the Prometheus text format on
+// GET /metrics. Scrapes are rare, each one sums the worker_metrics of every
+// io_context of the pool while the workers keep updating them.
+//
+// GET /log shows the runtime log level and debug scope, POST /log with the
+// query parameters level, client and user changes them. /log only answers
+// clients on the loopback address.
+class MetricsServer : private noncopyable {
+public:
+    MetricsServer(io_context_pool& pool, asio::io_context& ioc,
+                  const asio::ip::tcp::endpoint& endpoint);
+
+    // throws if the endpoint cannot be bound
+    void start();
+
+private:
+    class Scrape;
+
+    void do_accept();
+
+    std::string render();
+
+    // false if a parameter is unknown or invalid, nothing is changed then
+    bool update_log(const std::string& query);
+
+    std::string render_log();
+
+private:
+    io_context_pool& pool;
+    asio::io_context& ioc;
+    asio::ip::tcp::acceptor acceptor;
+    asio::ip::tcp::endpoint endpoint;
+};
\ No newline at end of file
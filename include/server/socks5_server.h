@@ -1,10 +1,9 @@
 #pragma once
 
 #include "common/common.h"
+#include "server/metrics_server.h"
 #include "util/io_context_pool.h"
 
-class Socks5Session;
-
 class Socks5Server : public noncopyable {
 public:
     Socks5Server(const std::string& host, uint16_t port, size_t thread_num);
@@ -18,14 +17,21 @@ private:
 
     void do_accept();
 
+    void start_session(asio::io_context& ioc, asio::ip::tcp::socket& socket);
+
     void stop();
 
+    // SIGHUP reloads the configuration file
+    void wait_reload();
+
+    void reload();
+
 protected:
     size_t pool_size;
-    size_t conn_timeout;
     io_context_pool pool;
     asio::signal_set signals;
+    asio::signal_set reload_signals;
     asio::ip::tcp::acceptor acceptor;
     asio::ip::tcp::endpoint listen_endpoint;
-    std::shared_ptr<Socks5Session> new_conn_ptr;
+    std::unique_ptr<MetricsServer> metrics_server;
 };
\ No newline at end of file
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <unordered_map>
+
+#include "common/common.h"
+#include "util/intrusive_ptr.h"
+#include "util/worker_metrics.h"
+
+class Socks5Session;
+
+// A UDP socket relaying datagrams for one or more UDP associations.
+// Datagrams are demultiplexed by sender endpoint : senders bound as clients
+// are handed to their association as SOCKS requests, senders bound as
+// servers are handed to the association that last sent to them.
+class UdpRelaySocket : public intrusive_ref_counter<UdpRelaySocket>,
+                       private noncopyable {
+public:
+    // shared relays belong to the UdpRelayPool of their io_context, private
+    // relays are owned by a single association
+    UdpRelaySocket(asio::io_context& ioc, const asio::ip::udp& protocol,
+                   bool shared);
+
+    void start();
+
+    void close();
+
+    inline bool is_shared() const { return shared; }
+
+    inline asio::ip::udp::socket& get_socket() { return socket; }
+
+    inline const asio::ip::udp::endpoint& get_local_endpoint() const {
+        return local_endpoint;
+    }
+
+    void bind_client(const asio::ip::udp::endpoint& endpoint,
+                     Socks5Session* session);
+
+    void unbind_client(const asio::ip::udp::endpoint& endpoint,
+                       Socks5Session* session);
+
+    // the client port is unknown, the first datagram from the address binds
+    // its sender endpoint to the session
+    void bind_client_address(const asio::ip::address& address,
+                             Socks5Session* session);
+
+    void unbind_client_address(const asio::ip::address& address,
+                               Socks5Session* session);
+
+    // private relays only : the first unknown sender becomes the client
+    void bind_any_client(Socks5Session* session);
+
+    // fails if the server is already bound to another association
+    bool bind_server(const asio::ip::udp::endpoint& endpoint,
+                     Socks5Session* session);
+
+    void unbind_server(const asio::ip::udp::endpoint& endpoint,
+                       Socks5Session* session);
+
+    inline bool serves_servers() const { return !servers.empty(); }
+
+    // private relays hold the datagram a busy association refused, resume
+    // delivers it once the association is ready again
+    void resume();
+
+private:
+    void do_receive();
+
+    bool dispatch();
+
+private:
+    bool shared;
+    bool held;
+    worker_metrics& stats;
+    asio::ip::udp::socket socket;
+    asio::ip::udp::endpoint local_endpoint;
+    asio::ip::udp::endpoint sender_endpoint;
+    size_t length;
+    std::vector<uint8_t> buffer;
+
+    Socks5Session* any_client;
+    std::unordered_map<asio::ip::udp::endpoint, Socks5Session*> clients;
+    std::unordered_multimap<asio::ip::address, Socks5Session*> pending_clients;
+    std::unordered_map<asio::ip::udp::endpoint, Socks5Session*> servers;
+};
+
+using udp_relay_ptr = intrusive_ptr<UdpRelaySocket>;
+
+// Fixed set of shared relay sockets per io_context, so the number of UDP
+// sockets no longer grows with the number of associations. A server replies
+// to a relay port, so a relay serves a server for one association only.
+// Associations that find every relay taken for their server get an extra
+// shared relay, which serves other servers too and is closed once it serves
+// none, so extra relays only grow with the associations of the busiest
+// server.
+class UdpRelayPool : public asio::execution_context::service {
+public:
+    static asio::execution_context::id id;
+
+    explicit UdpRelayPool(asio::io_context& ioc);
+
+    ~UdpRelayPool();
+
+    void set_pool_size(size_t size);
+
+    // relay socket for a new association, round robin
+    udp_relay_ptr acquire(const asio::ip::udp& protocol);
+
+    const std::vector<udp_relay_ptr>& get_relays(
+        const asio::ip::udp& protocol);
+
+    // shared relay serving server for session, preferred if it can, null if
+    // no relay socket could be opened
+    udp_relay_ptr bind_server(const asio::ip::udp::endpoint& server,
+                              Socks5Session* session,
+                              const udp_relay_ptr& preferred);
+
+    void unbind_server(const udp_relay_ptr& relay,
+                       const asio::ip::udp::endpoint& server,
+                       Socks5Session* session);
+
+private:
+    void shutdown() override;
+
+    void open_relays(std::vector<udp_relay_ptr>& relays,
+                     const asio::ip::udp& protocol);
+
+private:
+    asio::io_context& ioc;
+    size_t pool_size;
+    size_t next_v4_relay;
+    size_t next_v6_relay;
+    std::vector<udp_relay_ptr> v4_relays;
+    std::vector<udp_relay_ptr> v6_relays;
+    std::vector<udp_relay_ptr> extra_v4_relays;
+    std::vector<udp_relay_ptr> extra_v6_relays;
+};
\ No newline at end of file
@@ -0,0 +1,144 @@
+#pragma once
+
+#ifdef SOCKS_COROUTINE_SESSION
+
+#include "common/common.h"
+#include "common/socks5_type.h"
+#include "option/parser.h"
+#include "util/access_log.h"
+#include "util/worker_metrics.h"
+
+// Socks5Session written as C++20 coroutines, used instead of the callback
+// session when the server is built with SOCKS_COROUTINE_SESSION. The session
+// state lives in the frame of its run coroutine, the handshake is straight
+// line code and the relay adds one coroutine per direction.
+//
+// UDP ASSOCIATE uses a relay socket per association, fragmented datagrams
+// are dropped and udp_relay_sockets is ignored.
+class Socks5CoroutineSession : private noncopyable {
+public:
+    static asio::awaitable<void> run(asio::ip::tcp::socket socket,
+                                     size_t timeout);
+
+private:
+    Socks5CoroutineSession(asio::ip::tcp::socket&& socket, size_t timeout);
+
+    asio::awaitable<void> serve();
+
+    // ends once the connection has been idle for timeout seconds
+    asio::awaitable<void> watchdog();
+
+    void keep_alive();
+
+    void stop();
+
+    // records the duration of the step that ends now
+    void record_phase(latency phase);
+
+    // queues the access log record of the finished session
+    void write_access_record();
+
+    SocksV5::Method choose_method();
+
+    asio::awaitable<bool> negotiate_method();
+
+    asio::awaitable<bool> authenticate();
+
+    // reads CMD, ATYP, DST.ADDR and DST.PORT of the request
+    asio::awaitable<bool> read_request();
+
+    template <typename InternetProtocol>
+    asio::awaitable<void> reply(
+        SocksV5::ReplyREP rep,
+        const asio::ip::basic_endpoint<InternetProtocol>& endpoint);
+
+    asio::awaitable<void> reply_error(SocksV5::ReplyREP rep);
+
+    asio::awaitable<void> do_connect();
+
+    asio::awaitable<void> relay(asio::ip::tcp::socket& from,
+                                asio::ip::tcp::socket& to,
+                                std::vector<uint8_t>& buffer);
+
+    asio::awaitable<void> do_udp_associate();
+
+    // A UDP association terminates when the TCP connection that the UDP
+    // ASSOCIATE request arrived on terminates.
+    asio::awaitable<void> wait_udp_control();
+
+    asio::awaitable<void> relay_udp();
+
+    bool check_udp_client(const asio::ip::udp::endpoint& sender);
+
+    // returns false if the datagram is malformed
+    asio::awaitable<bool> send_udp_to_dst(uint8_t* data, size_t length);
+
+    asio::awaitable<void> send_udp_to_client(uint8_t* data, size_t length);
+
+private:
+    asio::ip::tcp::socket socket;
+    worker_metrics& stats;
+    access_log& access;
+    asio::ip::tcp::socket dst_socket;
+    asio::ip::udp::socket udp_socket;
+    asio::ip::tcp::resolver tcp_resolver;
+    asio::ip::udp::resolver udp_resolver;
+
+    /* Life Cycle Management */
+    asio::steady_timer deadline;
+    size_t timeout;
+
+    asio::ip::tcp::endpoint local_endpoint;
+    asio::ip::tcp::endpoint tcp_cli_endpoint;
+    asio::ip::tcp::endpoint tcp_dst_endpoint;
+    asio::ip::tcp::endpoint tcp_bnd_endpoint;
+    // formatted when a log statement first needs them
+    endpoint_text cli_text;
+    endpoint_text local_text;
+
+    /* Udp Associate */
+    asio::ip::udp::endpoint udp_cli_endpoint;
+    asio::ip::udp::endpoint udp_dst_endpoint;
+    asio::ip::udp::endpoint udp_bnd_endpoint;
+    // senders allowed to become the client, empty allows any sender
+    std::vector<asio::ip::udp::endpoint> udp_client_endpoints;
+    bool udp_client_bound;
+
+    /* Username/Password Authentication Step */
+    // ULEN is a single byte, the name fits in the session
+    uint8_t ulen;
+    uint8_t uname[255];
+
+    /* Request Step */
+    std::vector<SocksV5::Method> methods;
+    SocksV5::RequestCMD cmd;
+    SocksV5::RequestATYP request_atyp;
+    std::vector<uint8_t> dst_addr;
+    uint16_t dst_port;
+
+    /* Reply Step */
+    SocksV5::ReplyREP rep;
+
+    /* Common Buffer */
+    std::vector<uint8_t> client_buffer;
+    std::vector<uint8_t> dst_buffer;
+
+    /* Phase Timestamps */
+    std::chrono::steady_clock::time_point accepted_at;
+    // end of the previous step
+    std::chrono::steady_clock::time_point phase_at;
+    std::chrono::steady_clock::time_point connected_at;
+
+    /* Access Log */
+    uint64_t client_bytes_read;
+    uint64_t upstream_bytes_read;
+    // cmd and the destination were read, rep was sent
+    bool request_read;
+    bool replied;
+
+    /* Debug Scope */
+    // DEBUG and TRACE statements are logged whatever the runtime level
+    bool log_traced;
+};
+
+#endif
\ No newline at end of file
@@ -3,12 +3,25 @@
 #include "common/common.h"
 #include "common/socks5_type.h"
 #include "option/parser.h"
-
-class Socks5Session : public std::enable_shared_from_this<Socks5Session> {
+#include "server/udp_relay_pool.h"
+#include "util/access_log.h"
+#include "util/datagram_queue.h"
+#include "util/handler_allocator.h"
+#include "util/intrusive_ptr.h"
+#include "util/worker_metrics.h"
+#include "util/zerocopy_sender.h"
+
+class Socks5SessionPool;
+
+// Sessions are referenced through session_ptr only from the thread running
+// their io_context, so the reference count is not atomic.
+class Socks5Session {
 public:
-    explicit Socks5Session(asio::io_context& ioc_);
+    // the session returns to the pool once its last reference is released
+    explicit Socks5Session(asio::io_context& ioc_,
+                           Socks5SessionPool* pool_ = nullptr);
 
-    virtual ~Socks5Session() = default;
+    virtual ~Socks5Session();
 
     asio::ip::tcp::socket& get_socket();
 
@@ -16,6 +29,25 @@ public:
 
     void set_timeout(size_t second);
 
+    // stop the session and clear its state so the object can serve the next
+    // connection
+    void reset();
+
+    // datagrams delivered by the relay sockets of the association. A busy
+    // association queues them, false if its queue is full.
+    bool on_udp_client_message(UdpRelaySocket& relay,
+                               const asio::ip::udp::endpoint& sender,
+                               const uint8_t* data, size_t length);
+
+    bool on_udp_server_message(const asio::ip::udp::endpoint& sender,
+                               const uint8_t* data, size_t length);
+
+    friend void intrusive_ptr_add_ref(Socks5Session* session) noexcept {
+        ++session->ref_count;
+    }
+
+    friend void intrusive_ptr_release(Socks5Session* session) noexcept;
+
 private:
     inline void keep_alive();
 
@@ -23,6 +55,12 @@ private:
 
     void stop();
 
+    // records the duration of the step that ends now
+    void record_phase(latency phase);
+
+    // queues the access log record of the finished session
+    void write_access_record();
+
     //  +----+----------+----------+
     //  |VER | NMETHODS | METHODS |
     //  +----+----------+----------+
@@ -147,12 +185,43 @@ private:
 
     void connect_dst_host();
 
+    // opens dst_socket for tcp_dst_endpoint with the upstream socket options,
+    // so the buffer sizes are in place before the SYN is sent
+    bool open_dst_socket();
+
+    // connects dst_socket to tcp_dst_endpoint, with upstream fast open the
+    // client data pipelined behind the request is sent in the SYN
+    template <typename ConnectHandler>
+    void async_connect_dst(ConnectHandler handler) {
+        if (!this->send_early_data()) {
+            this->dst_socket.async_connect(this->tcp_dst_endpoint, handler);
+            return;
+        }
+
+        this->dst_socket.async_wait(
+            asio::ip::tcp::socket::wait_write,
+            make_custom_alloc_handler(
+                this->dst_handler_memory,
+                [this, handler](asio::error_code ec) mutable {
+                    if (!ec) {
+                        ec = this->get_connect_error();
+                    }
+                    handler(ec);
+                }));
+    }
+
+    // starts a fast open connect, false if a plain connect must be made
+    bool send_early_data();
+
+    asio::error_code get_connect_error();
+
+    // relays the early data the SYN could not carry, then the client data
+    void relay_early_data();
+
     void set_udp_associate_endpoint();
 
     void async_udp_dns_reslove();
 
-    bool check_sender_endpoint();
-
     bool check_dst_addr_all_zeros();
 
     //  The UDP ASSOCIATE request is used to establish an association within
@@ -170,6 +239,36 @@ private:
     //  UDP request messages to be relayed.
     void reply_udp_associate();
 
+    // per association relay socket, or one of the shared relay sockets of
+    // the io_context when udp_relay_sockets is configured
+    void open_udp_relay();
+
+    void register_udp_client();
+
+    void bind_udp_client(const asio::ip::udp::endpoint& endpoint);
+
+    // relay socket used to reach udp_dst_endpoint, a shared relay socket
+    // serves each UDP server for a single association at a time
+    bool bind_udp_server_relay();
+
+    void release_udp_server_relay();
+
+    void release_udp_relay();
+
+    //  A UDP association terminates when the TCP connection that the UDP
+    //  ASSOCIATE request arrived on terminates.
+    void wait_udp_control();
+
+    // the destination name is resolved while the association goes on with
+    // server datagrams, a name resolved lately is not resolved again
+    void async_send_udp_message();
+
+    // the datagram that waited for its name to resolve
+    void send_resolved_udp_message();
+
+    void try_to_send_by_iterator(
+        asio::ip::udp::resolver::results_type::const_iterator iter);
+
     //  +----+------+------+----------+----------+----------+
     //  |RSV | FRAG | ATYP | DST.ADDR | DST.PORT | DATA |
     //  +----+------+------+----------+----------+----------+
@@ -184,15 +283,29 @@ private:
     // (4) DST.ADDR desired destination address
     // (5) DST.PORT desired destination port
     // (6) DATA user data
-    void get_udp_client();
+    void parse_udp_message();
 
-    void async_send_udp_message();
+    // length of the ATYP, DST.ADDR and DST.PORT fields of the datagram in
+    // client_buffer, or 0 if the datagram is too short to hold them
+    size_t udp_header_length();
 
-    void try_to_send_by_iterator(
-        asio::ip::udp::resolver::results_type::const_iterator iter);
+    //  FRAG values run from 1 to 127, the high-order bit marks the end of a
+    //  fragment sequence. The reassembly queue is reinitialized whenever the
+    //  reassembly timer expires or a fragment arrives with a FRAG value not
+    //  following the sequence being processed. Returns true once the
+    //  client_buffer holds a complete unfragmented datagram.
+    bool reassemble_udp_fragment(uint8_t frag);
 
-    void parse_udp_message();
+    void reset_udp_reassembly();
+
+    void wait_reassembly_timeout();
+
+    // the datagram in client_buffer, from sender
+    void relay_udp_client_message(const asio::ip::udp::endpoint& sender);
 
+    void relay_udp_server_message(const asio::ip::udp::endpoint& sender);
+
+    // the association is ready for the next datagram, queued ones first
     void receive_udp_message();
 
     void send_udp_to_dst();
@@ -222,20 +335,62 @@ private:
     //      (4.3) IP V6 address: X’04’
     // (5) BND.ADDR server bound address
     // (6) BND.PORT server bound port in network octet order
+    //
+    // The relay starts as soon as the server is connected. The reply is held
+    // back until the first bytes from the server arrive and is sent with
+    // them in one write, but for connect_reply_delay milliseconds at most,
+    // so with the default of 0 it is sent right away.
     void reply_connect_result();
 
+    // the reply followed by write_length bytes of dst_buffer
+    void write_connect_reply(size_t write_length);
+
     void reply_and_stop(SocksV5::ReplyREP rep);
 
     void read_from_client();
 
+    // shared_relay_buffers : wait until the socket is readable, then read
+    // into a buffer borrowed from the buffer_pool of the io_context until
+    // the data has been sent
+    void wait_from_client();
+
     void send_to_dst(size_t write_length);
 
     void read_from_dst();
 
+    void wait_from_dst();
+
+    // EOF from one side shuts down sending to the other side while the
+    // opposite direction keeps relaying, the session stops once both
+    // directions are done
+    void shutdown_client_relay();
+
+    void shutdown_dst_relay();
+
     void send_to_client(size_t write_length);
 
+    // writes of at least zerocopy_threshold bytes are sent with MSG_ZEROCOPY,
+    // the buffer is held by the sender and read_next reads into a new one
+    void send_zerocopy(asio::ip::tcp::socket& socket, zerocopy_sender& sender,
+                       std::vector<uint8_t>& buffer, size_t offset,
+                       size_t write_length, void (Socks5Session::*read_next)());
+
+    // wait for completion notifications while the sender holds buffers
+    void wait_zerocopy(asio::ip::tcp::socket& socket, zerocopy_sender& sender);
+
+    // a socket whose sender still holds buffers is shut down and closed once
+    // the kernel is done with them
+    void close_relay_socket(asio::ip::tcp::socket& socket,
+                            zerocopy_sender& sender);
+
+private:
+    size_t ref_count;
+    Socks5SessionPool* pool;
+
 protected:
     asio::io_context& ioc;
+    worker_metrics& stats;
+    access_log& access;
 
     asio::ip::udp::resolver udp_resolver;
     asio::ip::udp::resolver::results_type resolve_results;
@@ -249,12 +404,14 @@ protected:
     asio::ip::tcp::endpoint tcp_cli_endpoint;
     asio::ip::tcp::endpoint tcp_dst_endpoint;
     asio::ip::tcp::endpoint tcp_bnd_endpoint;
+    // formatted when a log statement first needs them
+    endpoint_text cli_text;
+    endpoint_text local_text;
 
     /* Udp Associate */
     asio::ip::udp::endpoint udp_cli_endpoint;
     asio::ip::udp::endpoint udp_dst_endpoint;
     asio::ip::udp::endpoint udp_bnd_endpoint;
-    asio::ip::udp::endpoint sender_endpoint;
 
     SocksVersion ver;
     uint8_t rsv;
@@ -288,13 +445,107 @@ protected:
     uint16_t bnd_port;
 
     /* Udp Associate Step */
-    std::unique_ptr<asio::ip::udp::socket> udp_socket;
+    udp_relay_ptr udp_relay;
+    udp_relay_ptr udp_server_relay;
+    asio::ip::udp::endpoint udp_server_endpoint;
+    std::vector<asio::ip::udp::endpoint> udp_client_endpoints;
+    std::vector<asio::ip::address> udp_client_addresses;
+    bool udp_busy;
     uint16_t udp_rsv;
-    uint8_t frag;
 
     size_t udp_length;
 
+    /* Udp Datagram Queues */
+    // datagrams that arrived while the association was busy, the two queues
+    // take turns
+    datagram_queue udp_client_queue;
+    datagram_queue udp_server_queue;
+    bool udp_client_turn;
+    // client datagrams wait while the destination of one of them resolves
+    bool udp_resolving;
+    // the name resolved, the datagram goes out once the association is free
+    bool udp_resolved;
+    std::vector<uint8_t> udp_resolve_buffer;
+    size_t udp_resolve_length;
+    asio::ip::udp::resolver::results_type udp_resolve_results;
+    // destination resolve_results holds the endpoints of
+    std::vector<uint8_t> udp_resolved_name;
+    uint16_t udp_resolved_port;
+    asio::steady_timer::time_point udp_resolved_at;
+
+    /* Udp Fragment Reassembly */
+    asio::steady_timer frag_timer;
+    uint8_t frag_position;
+    std::vector<uint8_t> frag_header;
+    std::vector<uint8_t> frag_buffer;
+
     /* Common Buffer */
     std::vector<uint8_t> client_buffer;
     std::vector<uint8_t> dst_buffer;
-};
\ No newline at end of file
+    bool shared_relay_buffers;
+    size_t relay_buffer_size;
+
+    /* Connect Reply */
+    enum class ReplyState : uint8_t {
+        None,
+        // waiting for the first bytes from the server
+        Deferred,
+        Writing,
+    };
+    ReplyState reply_state;
+    asio::steady_timer reply_timer;
+    size_t connect_reply_delay;
+    // read from the server while the reply was being written
+    size_t pending_dst_length;
+
+    /* Half Close */
+    // EOF relayed from the client and from the server
+    bool client_relay_done;
+    bool dst_relay_done;
+
+    /* TCP Fast Open */
+    bool upstream_fast_open;
+    // client data pipelined behind the request, kept at the front of
+    // client_buffer until the connection is established
+    size_t early_data_length;
+    // bytes of the early data queued by the fast open connect
+    size_t early_data_sent;
+
+    /* Zero Copy Send */
+    size_t zerocopy_threshold;
+    // sends to the client and to the server
+    zerocopy_sender client_zerocopy;
+    zerocopy_sender dst_zerocopy;
+
+    /* Phase Timestamps */
+    std::chrono::steady_clock::time_point accepted_at;
+    // end of the previous step
+    std::chrono::steady_clock::time_point phase_at;
+    std::chrono::steady_clock::time_point connected_at;
+    bool first_byte_seen;
+
+    /* Access Log */
+    uint64_t client_bytes_read;
+    uint64_t upstream_bytes_read;
+    // cmd and the destination were read, rep was sent
+    bool request_read;
+    bool replied;
+
+    /* Debug Scope */
+    // DEBUG and TRACE statements are logged whatever the runtime level
+    bool log_traced;
+
+    /* Handler Memory */
+    // handshake, client to server relay and UDP control connection
+    handler_memory client_handler_memory;
+    // connect, server to client relay and UDP datagrams
+    handler_memory dst_handler_memory;
+    // replies, which may be written while both relay directions read
+    handler_memory reply_handler_memory;
+    // connect reply delay and UDP reassembly timeout
+    handler_memory timer_handler_memory;
+    // name resolves, a UDP one runs along with the datagrams
+    handler_memory resolve_handler_memory;
+};
+
+using session_ptr = intrusive_ptr<Socks5Session>;
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "common/common.h"
+#include "session/socks5_session.h"
+
+// Per io_context cache of stopped sessions. A recycled session keeps its
+// sockets, timers and buffers, so steady connection churn performs no
+// session allocation. Sessions are acquired and released on the thread
+// running the io_context.
+class Socks5SessionPool : public asio::execution_context::service {
+public:
+    static asio::execution_context::id id;
+
+    explicit Socks5SessionPool(asio::io_context& ioc);
+
+    ~Socks5SessionPool();
+
+    session_ptr acquire(asio::ip::tcp::socket&& socket);
+
+    // called when the last session_ptr to the session goes away
+    void release(Socks5Session* session);
+
+private:
+    void shutdown() override;
+
+private:
+    asio::io_context& ioc;
+    bool stopped;
+    size_t capacity;
+    std::vector<Socks5Session*> free_sessions;
+};
\ No newline at end of file
@@ -1,4 +1,5 @@
 #pragma once
 
 #include "option/parser.h"
-#include "server/socks5_server.h"
\ No newline at end of file
+#include "server/socks5_server.h"
+#include "util/access_log.h"
\ No newline at end of file
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "common/common.h"
+#include "util/spsc_ring.h"
+
+class worker_metrics;
+
+// One finished session. Addresses are kept as raw bytes, formatting is left
+// to the decoder.
+struct access_record {
+    // no request or no reply was read or sent
+    static const uint8_t none = 0xff;
+
+    // unix time in microseconds
+    uint64_t start_time;
+    uint64_t duration;
+    uint64_t client_bytes;
+    uint64_t upstream_bytes;
+    uint16_t client_port;
+    // 4 or 16 bytes of client_address are used
+    uint8_t client_address_length;
+    uint8_t client_address[16];
+    // SOCKS CMD and REP, none if the session ended before them
+    uint8_t cmd;
+    uint8_t rep;
+    // SOCKS ATYP of the destination, an IPv4, IPv6 or domain name address
+    uint8_t dst_atyp;
+    uint8_t dst_length;
+    uint8_t dst_address[255];
+    uint16_t dst_port;
+    uint8_t username_length;
+    uint8_t username[255];
+
+    // start_time and duration of a session that started at accepted_at
+    void set_times(std::chrono::steady_clock::time_point accepted_at);
+
+    void set_client(const asio::ip::tcp::endpoint& endpoint);
+
+    // address holds DST.ADDR as read from the request, port in host order
+    void set_destination(uint8_t atyp, const std::vector<uint8_t>& address,
+                         uint16_t port);
+
+    void set_username(const uint8_t* data, size_t length);
+};
+
+// File format : the magic, then one record after another, each made of a
+// 16 bit length followed by that many bytes of fields. Integers are little
+// endian and variable length fields are preceded by their 8 bit length.
+namespace access_log_format {
+
+const char magic[8] = {'S', 'O', 'C', 'K', 'S', 'A', 'L', '1'};
+
+// largest encoded record including its length field
+const size_t max_record_size =
+    2 + 4 * 8 + 2 + 1 + 16 + 3 + 1 + 255 + 2 + 1 + 255;
+
+size_t encode(const access_record& record, uint8_t* out);
+
+// decodes the fields following the length field, false if they are
+// malformed
+bool decode(const uint8_t* data, size_t length, access_record& record);
+
+}    // namespace access_log_format
+
+// Records of one io_context. The thread running the io_context produces
+// them and the writer thread consumes them. A full ring drops the record.
+using access_log_ring = spsc_ring<access_record>;
+
+// Drains the rings of every io_context into the access log file from a
+// background thread, so a slow disk never delays a session.
+class access_log_writer : private noncopyable {
+public:
+    static access_log_writer* getInstance();
+
+    // false if the file cannot be opened
+    bool start(const std::string& file, size_t queue_size,
+               std::chrono::milliseconds flush_interval);
+
+    // writes what is left in the rings and closes the file
+    void stop();
+
+    inline bool is_enabled() const { return enabled; }
+
+    // ring for an io_context, nullptr if the log is disabled. Called once
+    // per io_context.
+    std::shared_ptr<access_log_ring> add_ring();
+
+private:
+    access_log_writer();
+
+    void run();
+
+    // writes the records in the rings, returns the number written
+    size_t drain();
+
+private:
+    bool enabled;
+    size_t queue_size;
+    std::chrono::milliseconds flush_interval;
+    std::FILE* file;
+    std::vector<uint8_t> buffer;
+    std::thread thread;
+
+    std::mutex mutex;
+    std::condition_variable stopped_signal;
+    bool stopped;
+    std::vector<std::shared_ptr<access_log_ring>> rings;
+};
+
+// The access log ring of an io_context.
+class access_log : public asio::execution_context::service {
+public:
+    static asio::execution_context::id id;
+
+    explicit access_log(asio::execution_context& context);
+
+    inline bool is_enabled() const { return ring != nullptr; }
+
+    // slot for a record of a finished session, nullptr if the log is
+    // disabled or the ring is full. The drop is counted in worker_metrics.
+    access_record* prepare();
+
+    inline void commit() { ring->commit(); }
+
+private:
+    void shutdown() override {}
+
+private:
+    std::shared_ptr<access_log_ring> ring;
+    worker_metrics& stats;
+};
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+
+#include "common/common.h"
+#include "util/sha256.h"
+
+class ServerParser;
+
+// Per io_context cache of recently verified credentials, so clients that
+// reconnect often skip the password hash. Only successful verifications are
+// remembered, keyed by a SHA-256 digest of the username and password.
+// Entries expire after the configured TTL and belong to the configuration
+// snapshot that verified them, a reload invalidates all of them. The cache
+// is direct mapped with a fixed number of entries and is used on the thread
+// running the io_context.
+class auth_cache : public asio::execution_context::service {
+public:
+    static asio::execution_context::id id;
+
+    explicit auth_cache(asio::execution_context& context);
+
+    ~auth_cache();
+
+    // checks the credentials of config, consulting the cache first
+    bool check(const ServerParser& config, const uint8_t* uname, size_t ulen,
+               const uint8_t* passwd, size_t plen);
+
+private:
+    struct entry {
+        // generation of the verifying snapshot, 0 marks an empty entry
+        uint64_t generation;
+        std::chrono::steady_clock::time_point expiry;
+        uint8_t digest[sha256::digest_size];
+    };
+
+    void shutdown() override;
+
+private:
+    std::vector<entry> entries;
+};
\ No newline at end of file
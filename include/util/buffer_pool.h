@@ -0,0 +1,35 @@
+#pragma once
+
+#include "common/common.h"
+
+// Per io_context cache of relay buffers. Sessions borrow a buffer only while
+// data read from a socket is being relayed, so the memory for pending reads
+// is shared by all sessions of the io_context and an idle session holds no
+// buffer. Buffers are acquired and released on the thread running the
+// io_context.
+class buffer_pool : public asio::execution_context::service {
+public:
+    static asio::execution_context::id id;
+
+    explicit buffer_pool(asio::io_context& ioc);
+
+    ~buffer_pool();
+
+    inline size_t get_buffer_size() const { return buffer_size; }
+
+    // buffers of another size are dropped as they come back
+    void set_buffer_size(size_t size);
+
+    // swap a buffer of get_buffer_size() bytes into buffer
+    void acquire(std::vector<uint8_t>& buffer);
+
+    // take the buffer back, leaving it empty
+    void release(std::vector<uint8_t>& buffer);
+
+private:
+    void shutdown() override;
+
+private:
+    size_t buffer_size;
+    std::vector<std::vector<uint8_t>> free_buffers;
+};
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "common/common.h"
+#include "util/sha256.h"
+
+// Username/password credentials in an open addressing hash table keyed by
+// username. Passwords are kept as salted PBKDF2-HMAC-SHA-256 hashes, and
+// lookup and verification work on the bytes read from the client without
+// allocating.
+//
+// A credentials file has one user per line :
+//     username:iterations:salt_hex:hash_hex
+// where hash is PBKDF2-HMAC-SHA-256(password, salt, iterations) truncated to
+// 32 bytes. Empty lines and lines starting with '#' are skipped.
+class credential_store : private noncopyable {
+public:
+    // longest salt accepted, in bytes
+    static const size_t max_salt_length = 32;
+
+    credential_store();
+
+    // adds the users listed in file, false if the file cannot be read, a line
+    // is malformed or a username is listed twice
+    bool load_file(const std::string& file);
+
+    // adds a user given by its plain password, the password is hashed with a
+    // random salt. False if the username already exists.
+    bool add_user(const std::string& username, const std::string& password,
+                  uint32_t iterations = 1);
+
+    inline size_t size() const { return entries.size(); }
+
+    inline bool empty() const { return entries.empty(); }
+
+    bool verify(const uint8_t* username, size_t username_length,
+                const uint8_t* password, size_t password_length) const;
+
+private:
+    struct entry {
+        uint64_t hash;
+        uint32_t name_offset;
+        uint8_t name_length;
+        uint8_t salt_length;
+        uint32_t iterations;
+        uint8_t salt[max_salt_length];
+        uint8_t digest[sha256::digest_size];
+    };
+
+    // false if the username already exists
+    bool insert(const entry& user, const char* username);
+
+    const entry* find(const uint8_t* username, size_t length,
+                      uint64_t hash) const;
+
+    // keeps the table at most half full
+    void grow();
+
+private:
+    // usernames stored back to back, entries refer to them by offset
+    std::vector<char> names;
+    std::vector<entry> entries;
+    // entry index + 1, 0 marks an empty slot. The size is a power of two.
+    std::vector<uint32_t> slots;
+};
\ No newline at end of file
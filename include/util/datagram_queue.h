@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+
+#include "common/common.h"
+
+// Fixed size FIFO of datagrams waiting for a busy UDP association. Slots
+// keep their buffers, so once every slot has held a datagram of a given
+// size queueing no longer allocates. Used from one thread only.
+class datagram_queue : private noncopyable {
+public:
+    struct datagram {
+        asio::ip::udp::endpoint sender;
+        std::vector<uint8_t> data;
+        size_t length = 0;
+    };
+
+    explicit datagram_queue(size_t capacity)
+        : slots(capacity), head(0), count(0) {}
+
+    inline bool empty() const { return count == 0; }
+
+    // copies the datagram, false if the queue is full
+    bool push(const asio::ip::udp::endpoint& sender, const uint8_t* data,
+              size_t length) {
+        if (count == slots.size()) {
+            return false;
+        }
+
+        datagram& slot = slots[(head + count) % slots.size()];
+        slot.sender = sender;
+        if (slot.data.size() < length) {
+            slot.data.resize(length);
+        }
+        std::memcpy(slot.data.data(), data, length);
+        slot.length = length;
+        ++count;
+        return true;
+    }
+
+    // the oldest datagram, the queue must not be empty. Its buffer may be
+    // swapped for another one before pop.
+    inline datagram& front() { return slots[head]; }
+
+    void pop() {
+        head = (head + 1) % slots.size();
+        --count;
+    }
+
+    void clear() {
+        head = 0;
+        count = 0;
+    }
+
+private:
+    std::vector<datagram> slots;
+    size_t head;
+    size_t count;
+};
\ No newline at end of file
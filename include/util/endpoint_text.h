@@ -0,0 +1,76 @@
+#pragma once
+
+#include "asio.hpp"
+#include "spdlog/fmt/fmt.h"
+
+// "a.b.c.d:port" or "[v6%scope]:port" written to out, which must hold
+// max_endpoint_text bytes. Returns the length, out is not terminated.
+const size_t max_endpoint_text = 80;
+
+size_t write_endpoint_text(const asio::ip::address& address, uint16_t port,
+                           char* out);
+
+// Printable form of an endpoint that stays the same during a session. It is
+// built the first time a log statement that is enabled formats it, once per
+// session at most.
+class endpoint_text {
+public:
+    explicit endpoint_text(const asio::ip::tcp::endpoint& endpoint)
+        : endpoint(endpoint), length(0) {}
+
+    endpoint_text(const endpoint_text&) = delete;
+    endpoint_text& operator=(const endpoint_text&) = delete;
+
+    // the endpoint has changed
+    inline void clear() { length = 0; }
+
+    inline fmt::string_view view() const {
+        if (length == 0) {
+            length = write_endpoint_text(endpoint.address(), endpoint.port(),
+                                         text);
+        }
+        return fmt::string_view(text, length);
+    }
+
+private:
+    const asio::ip::tcp::endpoint& endpoint;
+    mutable size_t length;
+    mutable char text[max_endpoint_text];
+};
+
+namespace fmt {
+
+// endpoints are written straight into the log buffer
+template <typename InternetProtocol>
+struct formatter<asio::ip::basic_endpoint<InternetProtocol>> {
+    template <typename ParseContext>
+    constexpr auto parse(ParseContext& ctx) -> decltype(ctx.begin()) {
+        return ctx.begin();
+    }
+
+    template <typename FormatContext>
+    auto format(const asio::ip::basic_endpoint<InternetProtocol>& endpoint,
+                FormatContext& ctx) -> decltype(ctx.out()) {
+        char text[max_endpoint_text];
+        size_t length =
+            write_endpoint_text(endpoint.address(), endpoint.port(), text);
+        return std::copy(text, text + length, ctx.out());
+    }
+};
+
+template <>
+struct formatter<endpoint_text> {
+    template <typename ParseContext>
+    constexpr auto parse(ParseContext& ctx) -> decltype(ctx.begin()) {
+        return ctx.begin();
+    }
+
+    template <typename FormatContext>
+    auto format(const endpoint_text& endpoint, FormatContext& ctx)
+        -> decltype(ctx.out()) {
+        fmt::string_view text = endpoint.view();
+        return std::copy(text.begin(), text.end(), ctx.out());
+    }
+};
+
+}    // namespace fmt
\ No newline at end of file
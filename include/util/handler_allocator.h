@@ -0,0 +1,101 @@
+#pragma once
+
+#include <type_traits>
+
+#include "common/common.h"
+
+// Memory for the handler of one outstanding asynchronous operation. Chains
+// of operations that never overlap reuse the same storage, so steady state
+// I/O performs no heap allocation. Requests that do not fit or arrive while
+// the storage is in use fall back to operator new.
+class handler_memory : private noncopyable {
+public:
+    handler_memory() : in_use(false) {}
+
+    void* allocate(size_t size) {
+        if (!in_use && size <= sizeof(storage)) {
+            in_use = true;
+            return &storage;
+        }
+        return ::operator new(size);
+    }
+
+    void deallocate(void* pointer) noexcept {
+        if (pointer == &storage) {
+            in_use = false;
+        } else {
+            ::operator delete(pointer);
+        }
+    }
+
+private:
+    typename std::aligned_storage<1024>::type storage;
+    bool in_use;
+};
+
+template <typename T>
+class handler_allocator {
+public:
+    using value_type = T;
+
+    explicit handler_allocator(handler_memory& memory) noexcept
+        : memory(&memory) {}
+
+    template <typename U>
+    handler_allocator(const handler_allocator<U>& other) noexcept
+        : memory(other.memory) {}
+
+    T* allocate(size_t n) const {
+        return static_cast<T*>(memory->allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* pointer, size_t /*n*/) const noexcept {
+        memory->deallocate(pointer);
+    }
+
+    template <typename U>
+    bool operator==(const handler_allocator<U>& other) const noexcept {
+        return memory == other.memory;
+    }
+
+    template <typename U>
+    bool operator!=(const handler_allocator<U>& other) const noexcept {
+        return memory != other.memory;
+    }
+
+private:
+    template <typename U>
+    friend class handler_allocator;
+
+    handler_memory* memory;
+};
+
+// wraps a completion handler so asio allocates the operation through the
+// associated handler_allocator
+template <typename Handler>
+class custom_alloc_handler {
+public:
+    using allocator_type = handler_allocator<Handler>;
+
+    custom_alloc_handler(handler_memory& memory, Handler handler)
+        : memory(&memory), handler(std::move(handler)) {}
+
+    allocator_type get_allocator() const noexcept {
+        return allocator_type(*memory);
+    }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        handler(std::forward<Args>(args)...);
+    }
+
+private:
+    handler_memory* memory;
+    Handler handler;
+};
+
+template <typename Handler>
+inline custom_alloc_handler<Handler> make_custom_alloc_handler(
+    handler_memory& memory, Handler handler) {
+    return custom_alloc_handler<Handler>(memory, std::move(handler));
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+// Smart pointer to an object carrying its own non-atomic reference count,
+// found through intrusive_ptr_add_ref / intrusive_ptr_release. Objects that
+// are only referenced from the thread running their io_context avoid an
+// atomic read-modify-write on every completion handler copy.
+template <typename T>
+class intrusive_ptr {
+public:
+    intrusive_ptr() noexcept : pointer(nullptr) {}
+
+    intrusive_ptr(T* p) noexcept : pointer(p) {
+        if (pointer != nullptr) intrusive_ptr_add_ref(pointer);
+    }
+
+    intrusive_ptr(const intrusive_ptr& other) noexcept
+        : pointer(other.pointer) {
+        if (pointer != nullptr) intrusive_ptr_add_ref(pointer);
+    }
+
+    intrusive_ptr(intrusive_ptr&& other) noexcept : pointer(other.pointer) {
+        other.pointer = nullptr;
+    }
+
+    ~intrusive_ptr() {
+        if (pointer != nullptr) intrusive_ptr_release(pointer);
+    }
+
+    intrusive_ptr& operator=(intrusive_ptr other) noexcept {
+        std::swap(pointer, other.pointer);
+        return *this;
+    }
+
+    void reset() noexcept { intrusive_ptr().swap(*this); }
+
+    void swap(intrusive_ptr& other) noexcept {
+        std::swap(pointer, other.pointer);
+    }
+
+    T* get() const noexcept { return pointer; }
+
+    T& operator*() const noexcept { return *pointer; }
+
+    T* operator->() const noexcept { return pointer; }
+
+    explicit operator bool() const noexcept { return pointer != nullptr; }
+
+    bool operator==(const intrusive_ptr& other) const noexcept {
+        return pointer == other.pointer;
+    }
+
+    bool operator!=(const intrusive_ptr& other) const noexcept {
+        return pointer != other.pointer;
+    }
+
+private:
+    T* pointer;
+};
+
+// Reference count for objects deleted along with their last reference.
+template <typename T>
+class intrusive_ref_counter {
+public:
+    friend void intrusive_ptr_add_ref(const intrusive_ref_counter* p) noexcept {
+        ++p->ref_count;
+    }
+
+    friend void intrusive_ptr_release(const intrusive_ref_counter* p) noexcept {
+        if (--p->ref_count == 0) {
+            delete static_cast<const T*>(p);
+        }
+    }
+
+protected:
+    intrusive_ref_counter() noexcept : ref_count(0) {}
+
+    ~intrusive_ref_counter() = default;
+
+private:
+    mutable size_t ref_count;
+};
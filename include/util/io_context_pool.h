@@ -12,6 +12,22 @@ public:
 
     asio::io_context& get_io_context();
 
+    // posts a copy of handler to every io_context
+    template <typename Handler>
+    void post_all(const Handler& handler) {
+        for (auto&& io_context : io_contexts) {
+            asio::post(*io_context, handler);
+        }
+    }
+
+    // calls function with every io_context
+    template <typename Function>
+    void for_each(Function function) {
+        for (auto&& io_context : io_contexts) {
+            function(*io_context);
+        }
+    }
+
 private:
     using io_context_ptr = std::shared_ptr<asio::io_context>;
     using io_context_work =
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+#include "common/common.h"
+
+// Log-linear histogram of durations in microseconds, in the style of HDR
+// histograms : every power of two range is split into sub_buckets linear
+// buckets, so a recorded value is off by at most 1 / sub_buckets of itself.
+// Values from 2^(max_octave + 1) microseconds (about 67 s) on are only
+// counted in the overflow bucket. Like worker_metrics, one thread records
+// and any thread reads.
+class latency_histogram {
+public:
+    static const size_t sub_bucket_bits = 4;
+    static const size_t sub_buckets = 1 << sub_bucket_bits;
+    static const size_t max_octave = 25;
+    static const size_t bucket_count =
+        (max_octave - sub_bucket_bits + 1) * sub_buckets + sub_buckets;
+
+    latency_histogram();
+
+    inline void record(std::chrono::steady_clock::duration duration) {
+        auto value = std::chrono::duration_cast<std::chrono::microseconds>(
+                         duration)
+                         .count();
+        uint64_t us = value > 0 ? static_cast<uint64_t>(value) : 0;
+
+        size_t index = bucket_index(us);
+        increment(index < bucket_count ? buckets[index] : overflow, 1);
+        increment(sum, us);
+    }
+
+    inline uint64_t get_bucket(size_t index) const {
+        return buckets[index].load(std::memory_order_relaxed);
+    }
+
+    inline uint64_t get_overflow() const {
+        return overflow.load(std::memory_order_relaxed);
+    }
+
+    inline uint64_t get_sum() const {
+        return sum.load(std::memory_order_relaxed);
+    }
+
+    // exclusive upper bound of bucket index in microseconds
+    static uint64_t bucket_limit(size_t index);
+
+    // bucket_count for values that overflow
+    static size_t bucket_index(uint64_t us);
+
+private:
+    static inline void increment(std::atomic<uint64_t>& value, uint64_t n) {
+        value.store(value.load(std::memory_order_relaxed) + n,
+                    std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> buckets[bucket_count];
+    std::atomic<uint64_t> overflow;
+    std::atomic<uint64_t> sum;
+};
\ No newline at end of file
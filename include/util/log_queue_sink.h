@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "spdlog/sinks/sink.h"
+#include "util/spsc_ring.h"
+
+// A log message copied out of the logging thread.
+struct log_entry {
+    // longer messages are cut and end with ...
+    static const size_t max_payload = 448;
+
+    spdlog::log_clock::time_point time;
+    spdlog::source_loc source;
+    size_t thread_id;
+    spdlog::level::level_enum level;
+    uint16_t length;
+    char payload[max_payload];
+};
+
+// Sink in front of the real sinks. Every thread that logs copies the
+// formatted message into a ring of its own, a background thread drains the
+// rings into the real sinks, so neither a burst of messages nor a stalled
+// disk blocks the logging thread. A full ring drops the message and counts
+// it, the background thread reports the drops in the log.
+class log_queue_sink : public spdlog::sinks::sink {
+public:
+    log_queue_sink(std::vector<spdlog::sink_ptr> sinks, size_t queue_size,
+                   std::chrono::milliseconds flush_interval);
+
+    // writes what is left in the rings
+    ~log_queue_sink() override;
+
+    void log(const spdlog::details::log_msg& msg) override;
+
+    // the background thread flushes the real sinks after each pass
+    void flush() override {}
+
+    void set_pattern(const std::string& pattern) override;
+
+    void set_formatter(
+        std::unique_ptr<spdlog::formatter> sink_formatter) override;
+
+    // messages dropped by every thread so far
+    uint64_t dropped() const;
+
+private:
+    // a thread's ring and its drop counter
+    struct queue {
+        explicit queue(size_t size) : ring(size), dropped(0) {}
+
+        spsc_ring<log_entry> ring;
+        // written by the producer only
+        std::atomic<uint64_t> dropped;
+    };
+
+    // ring of the calling thread, created on its first message
+    queue& local_queue();
+
+    void run();
+
+    // writes the messages in the rings, returns the number written
+    size_t drain();
+
+private:
+    // tells the thread local queue of one sink from another
+    static std::atomic<uint64_t> next_id;
+
+    uint64_t id;
+    std::vector<spdlog::sink_ptr> sinks;
+    size_t queue_size;
+    std::chrono::milliseconds flush_interval;
+    // drops already reported by the background thread
+    uint64_t reported_dropped;
+    std::thread thread;
+
+    mutable std::mutex mutex;
+    std::condition_variable stopped_signal;
+    bool stopped;
+    std::vector<std::unique_ptr<queue>> queues;
+};
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// SHA-256 (FIPS 180-4). The state lives in the object, hashing never
+// allocates.
+class sha256 {
+public:
+    static const size_t digest_size = 32;
+    static const size_t block_size = 64;
+
+    sha256();
+
+    void update(const void* data, size_t length);
+
+    // writes digest_size bytes, the object must not be updated afterwards
+    void final(uint8_t* digest);
+
+    // compares two digests in a time that does not depend on where they
+    // differ
+    static bool equal(const uint8_t* a, const uint8_t* b);
+
+private:
+    void transform(const uint8_t* block);
+
+private:
+    uint32_t state[8];
+    uint64_t length;
+    uint8_t buffer[block_size];
+    size_t buffered;
+};
+
+// PBKDF2 with HMAC-SHA-256 (RFC 8018), the first sha256::digest_size bytes
+// of the derived key
+void pbkdf2_sha256(const uint8_t* password, size_t password_length,
+                   const uint8_t* salt, size_t salt_length,
+                   uint32_t iterations, uint8_t* key);
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "common/common.h"
+
+// TCP options set on one kind of socket. Zero and empty values keep the
+// system default.
+struct socket_options {
+    socket_options();
+
+    bool no_delay;
+    bool keep_alive;
+    // keepalive idle time and probe interval in seconds
+    int keep_idle;
+    int keep_interval;
+    int keep_count;
+    int send_buffer_size;
+    int receive_buffer_size;
+    // unsent bytes the kernel queues before the socket stops being writable
+    int notsent_lowat;
+    // milliseconds transmitted data may stay unacknowledged
+    int user_timeout;
+    std::string congestion_control;
+    // TCP Fast Open, listeners accept data in the SYN from up to
+    // fast_open_queue pending connections, upstream connects send the
+    // client data pipelined behind the request in the SYN
+    bool fast_open;
+    int fast_open_queue;
+
+    // every option is tried, ec holds the last failure. Options the platform
+    // does not know are skipped.
+    void apply(asio::ip::tcp::socket& socket, asio::error_code& ec) const;
+
+    // sockets accepted by a listener inherit its options on Linux
+    void apply(asio::ip::tcp::acceptor& acceptor, asio::error_code& ec) const;
+};
\ No newline at end of file
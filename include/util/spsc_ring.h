@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Fixed size ring with one producer thread and one consumer thread, neither
+// side locks. The producer fills the slot returned by prepare in place and
+// publishes it with commit, a full ring returns no slot and the caller drops
+// what it had to write.
+template <typename T>
+class spsc_ring {
+public:
+    // capacity is rounded up to a power of two
+    explicit spsc_ring(size_t size) : head(0), tail(0) {
+        size_t capacity = 1;
+        while (capacity < size) {
+            capacity <<= 1;
+        }
+        slots.resize(capacity);
+        mask = capacity - 1;
+    }
+
+    spsc_ring(const spsc_ring&) = delete;
+    spsc_ring& operator=(const spsc_ring&) = delete;
+
+    // producer : slot for the next element, nullptr if the ring is full
+    T* prepare() {
+        size_t head = this->head.load(std::memory_order_relaxed);
+        if (head - this->tail.load(std::memory_order_acquire) ==
+            slots.size()) {
+            return nullptr;
+        }
+        return &slots[head & mask];
+    }
+
+    // producer : publishes the slot returned by prepare
+    void commit() {
+        this->head.store(this->head.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_release);
+    }
+
+    // consumer : calls handler for every published element
+    template <typename Handler>
+    size_t consume(Handler handler) {
+        size_t tail = this->tail.load(std::memory_order_relaxed);
+        size_t head = this->head.load(std::memory_order_acquire);
+        for (size_t i = tail; i != head; i++) {
+            handler(slots[i & mask]);
+        }
+        this->tail.store(head, std::memory_order_release);
+        return head - tail;
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask;
+    // written by the producer and the consumer only, padded onto separate
+    // cache lines since C++11 allocation ignores over-alignment
+    char padding_before[64];
+    std::atomic<size_t> head;
+    char padding_between[64];
+    std::atomic<size_t> tail;
+    char padding_after[64];
+};
\ No newline at end of file
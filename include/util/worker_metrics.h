@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+
+#include "common/common.h"
+#include "common/socks5_type.h"
+#include "util/latency_histogram.h"
+
+// Values kept by every worker. Labelled series of one family are adjacent.
+enum class metric : size_t {
+    sessions_accepted,
+    sessions_active,
+    client_bytes,
+    upstream_bytes,
+    // handshake failures by reason
+    failed_version,
+    failed_method,
+    failed_auth,
+    failed_command,
+    failed_address_type,
+    failed_resolve,
+    failed_connect,
+    failed_server,
+    dns_lookups,
+    dns_failures,
+    udp_client_datagrams,
+    udp_upstream_datagrams,
+    // refused by a busy association on a shared relay socket
+    udp_dropped_datagrams,
+    access_log_dropped,
+    count,
+};
+
+// Durations of the steps of a connection, each one measured from the end of
+// the step before it
+enum class latency : size_t {
+    // accept to the method list read
+    greeting,
+    // the username and password read and checked
+    auth,
+    // the request read
+    request,
+    // the domain name resolved
+    resolve,
+    // the server connected
+    connect,
+    // connected to the reply written
+    reply,
+    // connected to the first bytes from the server
+    first_byte,
+    // accept to the reply written
+    setup,
+    count,
+};
+
+struct metric_info {
+    const char* name;
+    // label pairs without braces, empty for unlabelled series
+    const char* labels;
+    const char* type;
+    const char* help;
+};
+
+// Per io_context metrics. Only the thread running the io_context updates
+// them, so an update is a relaxed load and store of its own slot, no locked
+// instruction and no lock. Scrapes read the slots of every worker from
+// another thread and sum them.
+class worker_metrics : public asio::execution_context::service {
+public:
+    static asio::execution_context::id id;
+
+    explicit worker_metrics(asio::execution_context& context);
+
+    static const metric_info& describe(metric m);
+
+    // label of the phase in the duration histogram
+    static const char* describe(latency l);
+
+    inline void add(metric m, uint64_t n = 1) {
+        auto& value = values[static_cast<size_t>(m)];
+        value.store(value.load(std::memory_order_relaxed) + n,
+                    std::memory_order_relaxed);
+    }
+
+    // gauges go down by adding the two's complement, only the sum over
+    // the workers is meaningful
+    inline void sub(metric m, uint64_t n = 1) { this->add(m, 0 - n); }
+
+    // any thread
+    inline uint64_t get(metric m) const {
+        return values[static_cast<size_t>(m)].load(std::memory_order_relaxed);
+    }
+
+    inline void observe(latency l, std::chrono::steady_clock::duration d) {
+        histograms[static_cast<size_t>(l)].record(d);
+    }
+
+    // any thread
+    inline const latency_histogram& get(latency l) const {
+        return histograms[static_cast<size_t>(l)];
+    }
+
+    // counts the failure reported to the client by a reply
+    void add_failure(SocksV5::ReplyREP rep);
+
+private:
+    void shutdown() override {}
+
+private:
+    // keeps the slots of different workers off each other's cache lines
+    char padding_before[64];
+    std::atomic<uint64_t> values[static_cast<size_t>(metric::count)];
+    latency_histogram histograms[static_cast<size_t>(latency::count)];
+    char padding_after[64];
+};
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <deque>
+
+#include "common/common.h"
+#include "util/buffer_pool.h"
+
+// MSG_ZEROCOPY sends on a TCP socket (Linux 4.14+). The kernel keeps reading
+// a buffer after the send call returned, so each buffer is held until the
+// completion notifications read from the socket error queue cover every
+// send made from it, and only then goes back to the buffer_pool.
+class zerocopy_sender : private noncopyable {
+public:
+    zerocopy_sender();
+
+    // turns SO_ZEROCOPY on for the socket, false if it is not supported
+    bool enable(asio::ip::tcp::socket& socket);
+
+    inline bool is_enabled() const { return enabled; }
+
+    // buffers are held, or sends of the buffer not held yet are in flight
+    inline bool has_pending() const {
+        return !pending.empty() || next_id - hold_id != unheld_completed;
+    }
+
+    // an error queue wait is outstanding
+    inline bool is_waiting() const { return waiting; }
+
+    inline void set_waiting(bool value) { waiting = value; }
+
+    // the session stopped while buffers were pending, the socket is only
+    // shut down until their completions arrive
+    inline bool is_lingering() const { return lingering; }
+
+    inline void linger() { lingering = true; }
+
+    // one non-blocking send, returns the number of bytes queued. Falls back
+    // to copying when the kernel runs out of notification memory.
+    size_t send(asio::ip::tcp::socket& socket, const uint8_t* data,
+                size_t length, asio::error_code& ec);
+
+    // hold the buffer until the sends made since the previous hold complete,
+    // the buffer is left empty
+    void hold(std::vector<uint8_t>& buffer, buffer_pool& pool);
+
+    // read the error queue and recycle the buffers the kernel is done with
+    void complete(asio::ip::tcp::socket& socket, buffer_pool& pool);
+
+    // drop held buffers without recycling them and disable the sender
+    void clear();
+
+private:
+    void acknowledge(uint32_t first, uint32_t last);
+
+private:
+    struct pending_buffer {
+        uint32_t first_id;
+        uint32_t last_id;
+        uint32_t remaining;
+        std::vector<uint8_t> buffer;
+    };
+
+    bool enabled;
+    bool waiting;
+    bool lingering;
+    // notification id of the next zerocopy send
+    uint32_t next_id;
+    // notification id of the first send since the previous hold
+    uint32_t hold_id;
+    // sends since the previous hold that completed before their buffer was
+    // held, a partial send waits for the socket while the error queue is read
+    uint32_t unheld_completed;
+    std::deque<pending_buffer> pending;
+};
\ No newline at end of file
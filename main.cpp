@@ -2,17 +2,23 @@
 
 int main(int argc, char* argv[]) {
     // parse command options
-    if (ServerParser::global_config()->parse_config_file("../config.json") !=
-        true) {
+    auto config = ServerParser::load_config_file("../config.json");
+    if (!config) {
         std::printf("bad configuration file !!!");
         return EXIT_FAILURE;
     }
+    ServerParser::publish(std::move(config));
 
     // init log config
     if (Logger::getInstance()->Init(
             ServerParser::global_config()->get_log_file(),
             ServerParser::global_config()->get_max_rotate_size(),
-            ServerParser::global_config()->get_max_rotate_count())) {
+            ServerParser::global_config()->get_max_rotate_count(),
+            ServerParser::global_config()->get_log_queue_size())) {
+        Logger::SetLevel(ServerParser::global_config()->get_log_level());
+        Logger::getInstance()->SetDebugScope(
+            ServerParser::global_config()->get_log_debug_client(),
+            ServerParser::global_config()->get_log_debug_user());
         SPDLOG_INFO("Log initialization succeeded");
         SPDLOG_INFO("log_file : {}",
                     ServerParser::global_config()->get_log_file());
@@ -20,14 +26,37 @@ int main(int argc, char* argv[]) {
                     ServerParser::global_config()->get_max_rotate_size());
         SPDLOG_INFO("max_rotate_count : {}",
                     ServerParser::global_config()->get_max_rotate_count());
+        SPDLOG_INFO("log queue_size : {}",
+                    ServerParser::global_config()->get_log_queue_size());
     } else {
         return EXIT_FAILURE;
     }
 
-    Socks5Server server(ServerParser::global_config()->get_host(),
-                        ServerParser::global_config()->get_port(),
-                        ServerParser::global_config()->get_thread_num());
-    server.start();
+    // the access log is optional, the proxy runs without it
+    std::string access_log_file =
+        ServerParser::global_config()->get_access_log_file();
+    if (!access_log_file.empty()) {
+        std::chrono::milliseconds flush_interval(
+            ServerParser::global_config()->get_access_log_flush_interval());
+        if (access_log_writer::getInstance()->start(
+                access_log_file,
+                ServerParser::global_config()->get_access_log_queue_size(),
+                flush_interval)) {
+            SPDLOG_INFO("access_log_file : {}", access_log_file);
+        } else {
+            SPDLOG_WARN("Failed to Open Access Log {}", access_log_file);
+        }
+    }
+
+    {
+        Socks5Server server(ServerParser::global_config()->get_host(),
+                            ServerParser::global_config()->get_port(),
+                            ServerParser::global_config()->get_thread_num());
+        server.start();
+    }
+
+    // sessions still open at shutdown finish while the server is destroyed
+    access_log_writer::getInstance()->stop();
 
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -1,6 +1,25 @@
 #include "common/logger.h"
 
 #include <cstdio>
+#include <cstring>
+
+namespace {
+
+// how long a message may wait in its queue before it is written
+const std::chrono::milliseconds log_flush_interval(100);
+
+#ifndef NDEBUG
+const int default_level = SPDLOG_ACTIVE_LEVEL;
+#else
+// release builds compile DEBUG statements in but log from INFO up
+const int default_level = SPDLOG_ACTIVE_LEVEL > SPDLOG_LEVEL_INFO
+                              ? SPDLOG_ACTIVE_LEVEL
+                              : SPDLOG_LEVEL_INFO;
+#endif
+
+}    // namespace
+
+std::atomic<int> Logger::runtime_level(default_level);
 
 Logger* Logger::getInstance() {
     static Logger logger;
@@ -8,49 +27,33 @@ Logger* Logger::getInstance() {
 }
 
 bool Logger::Init(const std::string& log_file, long unsigned max_rotateSize,
-                  long unsigned max_rotateCount) {
+                  long unsigned max_rotateCount, size_t queue_size) {
     try {
-        spdlog::init_thread_pool(8192, 1);
-        auto console_sink =
-            std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
         auto file_sink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>(
             log_file, max_rotateSize, max_rotateCount);
+        // the logging threads never wait for the sinks, the queue sink
+        // drops what its queues cannot hold
 #ifndef NDEBUG
-        spdlog::set_default_logger(std::make_shared<spdlog::async_logger>(
-            "debug_logger", spdlog::sinks_init_list({console_sink, file_sink}),
-            spdlog::thread_pool(),
-            spdlog::async_overflow_policy::overrun_oldest));
+        auto console_sink =
+            std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+        auto sink = std::make_shared<log_queue_sink>(
+            std::vector<spdlog::sink_ptr>{console_sink, file_sink}, queue_size,
+            log_flush_interval);
+        spdlog::set_default_logger(
+            std::make_shared<spdlog::logger>("debug_logger", sink));
 #else    // Release
-        spdlog::set_default_logger(std::make_shared<spdlog::async_logger>(
-            "release_logger", file_sink, spdlog::thread_pool(),
-            spdlog::async_overflow_policy::block));
+        auto sink = std::make_shared<log_queue_sink>(
+            std::vector<spdlog::sink_ptr>{file_sink}, queue_size,
+            log_flush_interval);
+        spdlog::set_default_logger(
+            std::make_shared<spdlog::logger>("release_logger", sink));
 #endif
+        this->queue_sink = sink;
 
-        switch (SPDLOG_ACTIVE_LEVEL) {
-            case SPDLOG_LEVEL_TRACE:
-                spdlog::set_level(spdlog::level::trace);
-                break;
-            case SPDLOG_LEVEL_DEBUG:
-                spdlog::set_level(spdlog::level::debug);
-                break;
-            case SPDLOG_LEVEL_INFO:
-                spdlog::set_level(spdlog::level::info);
-                break;
-            case SPDLOG_LEVEL_WARN:
-                spdlog::set_level(spdlog::level::warn);
-                break;
-            case SPDLOG_LEVEL_ERROR:
-                spdlog::set_level(spdlog::level::err);
-                break;
-            case SPDLOG_LEVEL_CRITICAL:
-                spdlog::set_level(spdlog::level::critical);
-                break;
-            case SPDLOG_LEVEL_OFF:
-                spdlog::set_level(spdlog::level::off);
-                break;
-            default:
-                break;
-        }
+        // the runtime level filters before spdlog, which passes every
+        // statement compiled in
+        spdlog::set_level(
+            static_cast<spdlog::level::level_enum>(SPDLOG_ACTIVE_LEVEL));
 
         spdlog::set_pattern("[%Y-%m-%d %T.%f] [%^%l%$] [thread %t] %v");
 
@@ -59,4 +62,68 @@ bool Logger::Init(const std::string& log_file, long unsigned max_rotateSize,
         return false;
     }
     return true;
+}
+
+uint64_t Logger::GetDroppedMessages() const {
+    auto sink = this->queue_sink.lock();
+    return sink ? sink->dropped() : 0;
+}
+
+spdlog::level::level_enum Logger::DefaultLevel() {
+    return static_cast<spdlog::level::level_enum>(default_level);
+}
+
+void Logger::SetLevel(spdlog::level::level_enum level) {
+    runtime_level.store(level, std::memory_order_relaxed);
+}
+
+bool Logger::SetDebugScope(const std::string& client,
+                           const std::string& user) {
+    asio::ip::address address;
+    if (!client.empty()) {
+        asio::error_code ec;
+        address = asio::ip::make_address(client, ec);
+        if (ec) {
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(this->scope_mutex);
+    this->scope_client = client;
+    this->scope_address = address;
+    this->scope_user = user;
+    this->scoped.store(!client.empty() || !user.empty(),
+                       std::memory_order_relaxed);
+    return true;
+}
+
+void Logger::GetDebugScope(std::string& client, std::string& user) const {
+    std::lock_guard<std::mutex> lock(this->scope_mutex);
+    client = this->scope_client;
+    user = this->scope_user;
+}
+
+bool Logger::InDebugScope(const asio::ip::address& address,
+                          const uint8_t* user, size_t ulen) const {
+    if (!this->scoped.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    // clients of a dual stack listener arrive as mapped IPv4 addresses
+    asio::ip::address client = address;
+    if (client.is_v6() && client.to_v6().is_v4_mapped()) {
+        client = asio::ip::make_address_v4(asio::ip::v4_mapped,
+                                           client.to_v6());
+    }
+
+    std::lock_guard<std::mutex> lock(this->scope_mutex);
+    if (!this->scope_client.empty() && this->scope_address != client) {
+        return false;
+    }
+    if (!this->scope_user.empty() &&
+        (user == nullptr || this->scope_user.size() != ulen ||
+         std::memcmp(this->scope_user.data(), user, ulen) != 0)) {
+        return false;
+    }
+    return true;
 }
\ No newline at end of file
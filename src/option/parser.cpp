@@ -4,14 +4,112 @@
 
 using json = nlohmann::json;
 
+namespace {
+
+void parse_socket_options(const json& config, socket_options& options) {
+    if (config.contains("no_delay")) {
+        options.no_delay = config["no_delay"].get<bool>();
+    }
+    if (config.contains("keep_alive")) {
+        options.keep_alive = config["keep_alive"].get<bool>();
+    }
+    if (config.contains("keep_idle")) {
+        options.keep_idle = config["keep_idle"].get<int>();
+    }
+    if (config.contains("keep_interval")) {
+        options.keep_interval = config["keep_interval"].get<int>();
+    }
+    if (config.contains("keep_count")) {
+        options.keep_count = config["keep_count"].get<int>();
+    }
+    if (config.contains("send_buffer_size")) {
+        options.send_buffer_size = config["send_buffer_size"].get<int>();
+    }
+    if (config.contains("receive_buffer_size")) {
+        options.receive_buffer_size =
+            config["receive_buffer_size"].get<int>();
+    }
+    if (config.contains("notsent_lowat")) {
+        options.notsent_lowat = config["notsent_lowat"].get<int>();
+    }
+    if (config.contains("user_timeout")) {
+        options.user_timeout = config["user_timeout"].get<int>();
+    }
+    if (config.contains("congestion_control")) {
+        options.congestion_control =
+            config["congestion_control"].get<std::string>();
+    }
+    if (config.contains("fast_open")) {
+        options.fast_open = config["fast_open"].get<bool>();
+    }
+    if (config.contains("fast_open_queue")) {
+        options.fast_open_queue = config["fast_open_queue"].get<int>();
+    }
+}
+
+// owns the current snapshot
+std::unique_ptr<const ServerParser> published_config;
+
+std::atomic<uint64_t> next_generation(1);
+
+}    // namespace
+
+std::atomic<const ServerParser*> ServerParser::current(nullptr);
+
+std::unique_ptr<ServerParser> ServerParser::load_config_file(
+    const std::string& config_file) {
+    std::unique_ptr<ServerParser> config(new ServerParser());
+    try {
+        if (!config->parse_config_file(config_file)) {
+            return nullptr;
+        }
+    } catch (const std::exception& e) {    // values of the wrong type
+        std::printf("%s", e.what());
+        return nullptr;
+    }
+    config->config_file = config_file;
+    config->generation = next_generation.fetch_add(1);
+    return config;
+}
+
+std::unique_ptr<const ServerParser> ServerParser::publish(
+    std::unique_ptr<const ServerParser> config) {
+    published_config.swap(config);
+    current.store(published_config.get(), std::memory_order_release);
+    return config;
+}
+
 ServerParser::ServerParser()
-    : host("127.0.0.1"),
+    : generation(0),
+      host("127.0.0.1"),
       port(1080),
       thread_num(std::thread::hardware_concurrency()),
+      udp_relay_sockets(0),
+      session_pool_size(256),
+      shared_relay_buffers(false),
+      relay_buffer_size(BUFSIZ),
+      zerocopy_threshold(0),
+      connect_reply_delay(0),
       conn_timeout(10 * 60),
+      listen_backlog(asio::socket_base::max_listen_connections),
+      metrics_host("127.0.0.1"),
+      metrics_port(0),
+      access_log_queue_size(1024),
+      access_log_flush_interval(1000),
       log_file("logs/server.log"),
       max_rotate_size(1024 * 1024),
-      max_rotate_count(10) {}
+      max_rotate_count(10),
+      log_queue_size(4096),
+      log_level(Logger::DefaultLevel()),
+      auth_cache_size(1024),
+      auth_cache_ttl(60) {
+    // relayed traffic is often interactive, send small writes immediately
+    // and keep the unsent part of the socket buffer short
+    client_socket_options.no_delay = true;
+    client_socket_options.notsent_lowat = 16384;
+    upstream_socket_options.no_delay = true;
+    upstream_socket_options.notsent_lowat = 16384;
+}
 
 bool ServerParser::parse_config_file(const std::string& config_file) {
     std::ifstream f(config_file);
@@ -34,6 +132,56 @@ bool ServerParser::parse_config_file(const std::string& config_file) {
         if (server_config.contains("thread_num")) {
             thread_num = server_config["thread_num"].get<size_t>();
         }
+        if (server_config.contains("udp_relay_sockets")) {
+            udp_relay_sockets =
+                server_config["udp_relay_sockets"].get<size_t>();
+        }
+        if (server_config.contains("session_pool_size")) {
+            session_pool_size =
+                server_config["session_pool_size"].get<size_t>();
+        }
+        if (server_config.contains("shared_relay_buffers")) {
+            shared_relay_buffers =
+                server_config["shared_relay_buffers"].get<bool>();
+        }
+        if (server_config.contains("relay_buffer_size")) {
+            relay_buffer_size =
+                server_config["relay_buffer_size"].get<size_t>();
+            if (relay_buffer_size == 0) {
+                return false;
+            }
+        }
+        if (server_config.contains("zerocopy_threshold")) {
+            zerocopy_threshold =
+                server_config["zerocopy_threshold"].get<size_t>();
+        }
+        if (server_config.contains("connect_reply_delay")) {
+            connect_reply_delay =
+                server_config["connect_reply_delay"].get<size_t>();
+        }
+    }
+    auto metrics_config = data["metrics"];
+    if (metrics_config.is_object() && !metrics_config.empty()) {
+        if (metrics_config.contains("host")) {
+            metrics_host = metrics_config["host"].get<std::string>();
+        }
+        if (metrics_config.contains("port")) {
+            metrics_port = metrics_config["port"].get<uint16_t>();
+        }
+    }
+    auto access_log_config = data["access_log"];
+    if (access_log_config.is_object() && !access_log_config.empty()) {
+        if (access_log_config.contains("file")) {
+            access_log_file = access_log_config["file"].get<std::string>();
+        }
+        if (access_log_config.contains("queue_size")) {
+            access_log_queue_size =
+                access_log_config["queue_size"].get<size_t>();
+        }
+        if (access_log_config.contains("flush_interval")) {
+            access_log_flush_interval =
+                access_log_config["flush_interval"].get<size_t>();
+        }
     }
     auto log_config = data["log"];
     if (log_config.is_object() && !log_config.empty()) {
@@ -48,19 +196,57 @@ bool ServerParser::parse_config_file(const std::string& config_file) {
             max_rotate_count =
                 log_config["max_rotate_count"].get<long unsigned>();
         }
+        if (log_config.contains("queue_size")) {
+            log_queue_size = log_config["queue_size"].get<size_t>();
+        }
+        if (log_config.contains("level")) {
+            std::string name = log_config["level"].get<std::string>();
+            // unknown names parse as off
+            log_level = spdlog::level::from_str(name);
+            if (log_level == spdlog::level::off && name != "off") {
+                return false;
+            }
+        }
+        if (log_config.contains("debug_client")) {
+            log_debug_client = log_config["debug_client"].get<std::string>();
+            asio::error_code ec;
+            asio::ip::make_address(log_debug_client, ec);
+            if (!log_debug_client.empty() && ec) {
+                return false;
+            }
+        }
+        if (log_config.contains("debug_user")) {
+            log_debug_user = log_config["debug_user"].get<std::string>();
+        }
     }
     auto auth_config = data["auth"];
     if (auth_config.is_object() && !auth_config.empty()) {
-        if (auth_config.contains("username")) {
-            username = auth_config["username"].get<std::string>();
-        } else {
-            return false;
+        // users from the credentials file, the inline user or both
+        if (auth_config.contains("credentials_file")) {
+            if (!credentials.load_file(
+                    auth_config["credentials_file"].get<std::string>())) {
+                return false;
+            }
+        }
+        if (auth_config.contains("username") ||
+            auth_config.contains("password")) {
+            if (!auth_config.contains("username") ||
+                !auth_config.contains("password") ||
+                !credentials.add_user(
+                    auth_config["username"].get<std::string>(),
+                    auth_config["password"].get<std::string>())) {
+                return false;
+            }
         }
-        if (auth_config.contains("password")) {
-            password = auth_config["password"].get<std::string>();
-        } else {
+        if (credentials.empty()) {
             return false;
         }
+        if (auth_config.contains("cache_size")) {
+            auth_cache_size = auth_config["cache_size"].get<size_t>();
+        }
+        if (auth_config.contains("cache_ttl")) {
+            auth_cache_ttl = auth_config["cache_ttl"].get<size_t>();
+        }
     }
     auto methods_config = data["supported-methods"];
     if (methods_config.is_array() && !methods_config.empty()) {
@@ -71,6 +257,25 @@ bool ServerParser::parse_config_file(const std::string& config_file) {
         return false;
     }
 
+    auto socket_config = data["socket_options"];
+    if (socket_config.is_object() && !socket_config.empty()) {
+        auto listener_config = socket_config["listener"];
+        if (listener_config.is_object()) {
+            parse_socket_options(listener_config, listener_socket_options);
+            if (listener_config.contains("backlog")) {
+                listen_backlog = listener_config["backlog"].get<int>();
+            }
+        }
+        auto client_config = socket_config["client"];
+        if (client_config.is_object()) {
+            parse_socket_options(client_config, client_socket_options);
+        }
+        auto upstream_config = socket_config["upstream"];
+        if (upstream_config.is_object()) {
+            parse_socket_options(upstream_config, upstream_socket_options);
+        }
+    }
+
     auto timeout_config = data["timeout"];
     if (timeout_config.is_number_unsigned()) {
         conn_timeout = timeout_config.get<size_t>();
@@ -0,0 +1,340 @@
+#include "server/metrics_server.h"
+
+#include <cctype>
+
+#include "util/worker_metrics.h"
+
+namespace {
+
+// a scrape request larger than this is refused
+const size_t max_request_size = 8192;
+
+// seconds a scraper may take to send its request
+const long scrape_timeout = 10;
+
+// le bounds of the exported phase histograms in microseconds, a 1-2-5
+// series. The fine internal buckets are folded into them.
+const uint64_t phase_bounds[] = {
+    100,      200,      500,      1000,     2000,     5000,    10000,
+    20000,    50000,    100000,   200000,   500000,   1000000, 2000000,
+    5000000,  10000000, 20000000, 50000000};
+
+// decodes %XX escapes and + of a query parameter, false if malformed
+bool decode_query_value(const std::string& value, std::string& decoded) {
+    decoded.clear();
+    for (size_t i = 0; i < value.size(); i++) {
+        if (value[i] == '+') {
+            decoded += ' ';
+        } else if (value[i] == '%') {
+            if (i + 2 >= value.size() ||
+                !std::isxdigit(static_cast<unsigned char>(value[i + 1])) ||
+                !std::isxdigit(static_cast<unsigned char>(value[i + 2]))) {
+                return false;
+            }
+            decoded += static_cast<char>(
+                std::stoi(value.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        } else {
+            decoded += value[i];
+        }
+    }
+    return true;
+}
+
+}    // namespace
+
+// one HTTP request, the connection is closed after the response
+class MetricsServer::Scrape : public std::enable_shared_from_this<Scrape> {
+public:
+    Scrape(MetricsServer& server, asio::ip::tcp::socket socket)
+        : server(server),
+          socket(std::move(socket)),
+          timer(this->socket.get_executor()),
+          request(max_request_size) {}
+
+    void start() {
+        auto self(this->shared_from_this());
+        this->timer.expires_after(asio::chrono::seconds(scrape_timeout));
+        this->timer.async_wait([this, self](asio::error_code ec) {
+            if (!ec) {
+                asio::error_code ignored_ec;
+                this->socket.close(ignored_ec);
+            }
+        });
+
+        asio::async_read_until(
+            this->socket, this->request, "\r\n\r\n",
+            [this, self](asio::error_code ec, size_t /*length*/) {
+                if (ec) {
+                    this->timer.cancel();
+                    return;
+                }
+                this->respond();
+            });
+    }
+
+private:
+    void respond() {
+        std::istream stream(&this->request);
+        std::string method, target;
+        stream >> method >> target;
+
+        size_t query_start = target.find('?');
+        std::string path = target.substr(0, query_start);
+        std::string query = query_start == std::string::npos
+                                ? std::string()
+                                : target.substr(query_start + 1);
+
+        std::string status = "200 OK";
+        std::string body;
+        if (path == "/metrics") {
+            if (method != "GET") {
+                status = "405 Method Not Allowed";
+            } else {
+                body = this->server.render();
+            }
+        } else if (path == "/log") {
+            if (!this->from_loopback()) {
+                status = "403 Forbidden";
+            } else if (method != "GET" && method != "POST") {
+                status = "405 Method Not Allowed";
+            } else if (method == "POST" && !this->server.update_log(query)) {
+                status = "400 Bad Request";
+            } else {
+                body = this->server.render_log();
+            }
+        } else {
+            status = "404 Not Found";
+        }
+
+        this->response = "HTTP/1.1 " + status +
+                         "\r\nContent-Type: text/plain; version=0.0.4"
+                         "\r\nContent-Length: " +
+                         std::to_string(body.size()) +
+                         "\r\nConnection: close\r\n\r\n" + body;
+
+        auto self(this->shared_from_this());
+        asio::async_write(this->socket, asio::buffer(this->response),
+                          [this, self](asio::error_code /*ec*/,
+                                       size_t /*length*/) {
+                              asio::error_code ignored_ec;
+                              this->socket.shutdown(
+                                  asio::ip::tcp::socket::shutdown_both,
+                                  ignored_ec);
+                              this->timer.cancel();
+                          });
+    }
+
+    // the log can be switched to DEBUG, only local users may do that
+    bool from_loopback() {
+        asio::error_code ec;
+        asio::ip::address address = this->socket.remote_endpoint(ec).address();
+        if (ec) {
+            return false;
+        }
+        if (address.is_v6() && address.to_v6().is_v4_mapped()) {
+            address = asio::ip::make_address_v4(asio::ip::v4_mapped,
+                                                 address.to_v6());
+        }
+        return address.is_loopback();
+    }
+
+private:
+    MetricsServer& server;
+    asio::ip::tcp::socket socket;
+    asio::steady_timer timer;
+    asio::streambuf request;
+    std::string response;
+};
+
+MetricsServer::MetricsServer(io_context_pool& pool, asio::io_context& ioc,
+                             const asio::ip::tcp::endpoint& endpoint)
+    : pool(pool), ioc(ioc), acceptor(ioc), endpoint(endpoint) {}
+
+void MetricsServer::start() {
+    this->acceptor.open(this->endpoint.protocol());
+    this->acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+    this->acceptor.bind(this->endpoint);
+    this->acceptor.listen();
+
+    SPDLOG_INFO("Metrics Server Listening on {}", this->endpoint);
+
+    this->do_accept();
+}
+
+void MetricsServer::do_accept() {
+    this->acceptor.async_accept(
+        this->ioc, [this](asio::error_code ec, asio::ip::tcp::socket socket) {
+            if (!ec) {
+                std::make_shared<Scrape>(*this, std::move(socket))->start();
+            } else if (ec == asio::error::operation_aborted) {
+                return;
+            }
+            this->do_accept();
+        });
+}
+
+std::string MetricsServer::render() {
+    std::vector<worker_metrics*> workers;
+    this->pool.for_each([&workers](asio::io_context& ioc) {
+        workers.push_back(&asio::use_service<worker_metrics>(ioc));
+    });
+
+    std::string text;
+    const char* family = "";
+    for (size_t i = 0; i < static_cast<size_t>(metric::count); i++) {
+        auto m = static_cast<metric>(i);
+        const metric_info& info = worker_metrics::describe(m);
+
+        uint64_t value = 0;
+        for (auto&& worker : workers) {
+            value += worker->get(m);
+        }
+
+        if (std::strcmp(family, info.name) != 0) {
+            family = info.name;
+            text += std::string("# HELP ") + info.name + " " + info.help +
+                    "\n# TYPE " + info.name + " " + info.type + "\n";
+        }
+        text += info.name;
+        if (info.labels[0] != '\0') {
+            text += std::string("{") + info.labels + "}";
+        }
+        // gauges are summed in two's complement
+        text += " " +
+                (std::strcmp(info.type, "gauge") == 0
+                     ? std::to_string(static_cast<int64_t>(value))
+                     : std::to_string(value)) +
+                "\n";
+    }
+
+    // the log queues belong to threads rather than io_contexts
+    text +=
+        "# HELP socks_log_dropped_total Log messages dropped because the "
+        "queue was full.\n"
+        "# TYPE socks_log_dropped_total counter\n"
+        "socks_log_dropped_total " +
+        std::to_string(Logger::getInstance()->GetDroppedMessages()) + "\n";
+
+    text +=
+        "# HELP socks_phase_duration_seconds Time spent in each step of "
+        "setting up a connection.\n"
+        "# TYPE socks_phase_duration_seconds histogram\n";
+    char number[32];
+    std::vector<uint64_t> overflows;
+    for (size_t i = 0; i < static_cast<size_t>(latency::count); i++) {
+        auto l = static_cast<latency>(i);
+        std::string phase =
+            std::string("phase=\"") + worker_metrics::describe(l) + "\"";
+
+        // buckets are cumulative in the exposition format, an internal
+        // bucket counts under the first bound its whole range lies below
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t overflow = 0;
+        size_t b = 0;
+        for (auto&& bound : phase_bounds) {
+            for (; b < latency_histogram::bucket_count &&
+                   latency_histogram::bucket_limit(b) - 1 <= bound;
+                 b++) {
+                for (auto&& worker : workers) {
+                    count += worker->get(l).get_bucket(b);
+                }
+            }
+            std::snprintf(number, sizeof(number), "%.9g", bound / 1e6);
+            text += "socks_phase_duration_seconds_bucket{" + phase +
+                    ",le=\"" + number + "\"} " + std::to_string(count) +
+                    "\n";
+        }
+        for (; b < latency_histogram::bucket_count; b++) {
+            for (auto&& worker : workers) {
+                count += worker->get(l).get_bucket(b);
+            }
+        }
+        for (auto&& worker : workers) {
+            sum += worker->get(l).get_sum();
+            overflow += worker->get(l).get_overflow();
+        }
+        count += overflow;
+        overflows.push_back(overflow);
+
+        text += "socks_phase_duration_seconds_bucket{" + phase +
+                ",le=\"+Inf\"} " + std::to_string(count) + "\n";
+        std::snprintf(number, sizeof(number), "%.9g", sum / 1e6);
+        text += "socks_phase_duration_seconds_sum{" + phase + "} " + number +
+                "\n";
+        text += "socks_phase_duration_seconds_count{" + phase + "} " +
+                std::to_string(count) + "\n";
+    }
+
+    // beyond the internal buckets, only the +Inf bucket holds these
+    text +=
+        "# HELP socks_phase_duration_overflow_total Steps that took longer "
+        "than the internal histogram buckets cover.\n"
+        "# TYPE socks_phase_duration_overflow_total counter\n";
+    for (size_t i = 0; i < static_cast<size_t>(latency::count); i++) {
+        text += std::string("socks_phase_duration_overflow_total{phase=\"") +
+                worker_metrics::describe(static_cast<latency>(i)) + "\"} " +
+                std::to_string(overflows[i]) + "\n";
+    }
+    return text;
+}
+
+bool MetricsServer::update_log(const std::string& query) {
+    spdlog::level::level_enum level = Logger::GetLevel();
+    std::string client, user;
+    Logger::getInstance()->GetDebugScope(client, user);
+
+    size_t start = 0;
+    while (start < query.size()) {
+        size_t end = query.find('&', start);
+        if (end == std::string::npos) {
+            end = query.size();
+        }
+        std::string parameter = query.substr(start, end - start);
+        start = end + 1;
+        if (parameter.empty()) {
+            continue;
+        }
+
+        size_t equal = parameter.find('=');
+        std::string key = parameter.substr(0, equal);
+        std::string value;
+        if (equal != std::string::npos &&
+            !decode_query_value(parameter.substr(equal + 1), value)) {
+            return false;
+        }
+
+        if (key == "level") {
+            // unknown names parse as off
+            level = spdlog::level::from_str(value);
+            if (level == spdlog::level::off && value != "off") {
+                return false;
+            }
+        } else if (key == "client") {
+            client = value;
+        } else if (key == "user") {
+            user = value;
+        } else {
+            return false;
+        }
+    }
+
+    if (!Logger::getInstance()->SetDebugScope(client, user)) {
+        return false;
+    }
+    Logger::SetLevel(level);
+
+    SPDLOG_INFO("Log Level Set to {}, Debug Scope Client [{}] User [{}]",
+                spdlog::level::to_string_view(level), client, user);
+    return true;
+}
+
+std::string MetricsServer::render_log() {
+    std::string client, user;
+    Logger::getInstance()->GetDebugScope(client, user);
+
+    auto level = spdlog::level::to_string_view(Logger::GetLevel());
+    return "level " + std::string(level.data(), level.size()) + "\nclient " +
+           client + "\nuser " + user + "\n";
+}
\ No newline at end of file
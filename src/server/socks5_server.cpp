@@ -1,16 +1,20 @@
 #include "server/socks5_server.h"
 
+#ifdef SOCKS_COROUTINE_SESSION
+#include "session/socks5_coroutine_session.h"
+#else
 #include "session/socks5_session.h"
+#include "session/socks5_session_pool.h"
+#endif
 
 Socks5Server::Socks5Server(const std::string& host, uint16_t port,
                            size_t thread_num)
     : pool_size(thread_num),
-      conn_timeout(ServerParser::global_config()->get_conn_timeout()),
       pool(pool_size),
       signals(pool.get_io_context()),
+      reload_signals(pool.get_io_context()),
       acceptor(pool.get_io_context()),
-      listen_endpoint(asio::ip::make_address(host), port),
-      new_conn_ptr() {}
+      listen_endpoint(asio::ip::make_address(host), port) {}
 
 Socks5Server::~Socks5Server() {
     SPDLOG_INFO("Socks5 Server Stop");
@@ -22,12 +26,12 @@ void Socks5Server::start() noexcept {
         init();
 
         SPDLOG_INFO("Socks5 Server Start");
-        SPDLOG_INFO("Socks5 Server Listening on {}",
-                    convert::format_address(listen_endpoint));
+        SPDLOG_INFO("Socks5 Server Listening on {}", listen_endpoint);
         SPDLOG_INFO("Socks5 Server Listening Address Type : {}",
                     listen_endpoint.address().is_v4() ? "IPv4" : "IPv6");
         SPDLOG_INFO("Socks5 Server Work Thread Num : {}", pool_size);
-        SPDLOG_INFO("Socks5 Server Connection Timeout : {}s", conn_timeout);
+        SPDLOG_INFO("Socks5 Server Connection Timeout : {}s",
+                    ServerParser::global_config()->get_conn_timeout());
 
         do_accept();
 
@@ -47,6 +51,41 @@ void Socks5Server::stop() {
     pool.stop();
 }
 
+void Socks5Server::wait_reload() {
+    reload_signals.async_wait([this](std::error_code ec, int /*signo*/) {
+        if (!ec) {
+            reload();
+            wait_reload();
+        }
+    });
+}
+
+void Socks5Server::reload() {
+    std::string config_file = ServerParser::global_config()->get_config_file();
+    auto config = ServerParser::load_config_file(config_file);
+    if (!config) {
+        SPDLOG_WARN("Failed to Reload {}, Keep the Current Configuration",
+                    config_file);
+        return;
+    }
+
+    // Readers never keep a snapshot beyond the handler that loaded it. Once
+    // every io_context has run a handler posted after the publish, no thread
+    // can still be reading the replaced snapshot, and the last copy of
+    // retired deletes it.
+    std::shared_ptr<const ServerParser> retired(
+        ServerParser::publish(std::move(config)));
+    pool.post_all([retired]() {});
+
+    // the log configuration replaces levels set through the metrics server
+    const ServerParser* current = ServerParser::global_config();
+    Logger::SetLevel(current->get_log_level());
+    Logger::getInstance()->SetDebugScope(current->get_log_debug_client(),
+                                         current->get_log_debug_user());
+
+    SPDLOG_INFO("Socks5 Server Configuration Reloaded from {}", config_file);
+}
+
 void Socks5Server::init() {
     signals.add(SIGINT);
     signals.add(SIGTERM);
@@ -55,23 +94,72 @@ void Socks5Server::init() {
 #endif
     signals.async_wait(std::bind(&Socks5Server::stop, this));
 
+#if defined(SIGHUP)
+    reload_signals.add(SIGHUP);
+    wait_reload();
+#endif
+
     acceptor.open(listen_endpoint.protocol());
     acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
     acceptor.bind(listen_endpoint);
-    acceptor.listen();
+
+    asio::error_code ec;
+    ServerParser::global_config()->get_listener_socket_options().apply(
+        acceptor, ec);
+    if (ec) {
+        SPDLOG_WARN("Failed to Set Listener Socket Options : ERR_MSG = [{}]",
+                    ec.message());
+    }
+
+    acceptor.listen(ServerParser::global_config()->get_listen_backlog());
+
+    // the metrics endpoint is optional, the proxy runs without it
+    if (ServerParser::global_config()->get_metrics_port() != 0) {
+        try {
+            asio::ip::tcp::endpoint metrics_endpoint(
+                asio::ip::make_address(
+                    ServerParser::global_config()->get_metrics_host()),
+                ServerParser::global_config()->get_metrics_port());
+            metrics_server.reset(new MetricsServer(pool, pool.get_io_context(),
+                                                   metrics_endpoint));
+            metrics_server->start();
+        } catch (const std::exception& e) {
+            SPDLOG_WARN("Failed to Start Metrics Server : ERR_MSG = [{}]",
+                        std::string(e.what()));
+            metrics_server.reset();
+        }
+    }
 }
 
 void Socks5Server::do_accept() {
-    new_conn_ptr.reset(new Socks5Session(pool.get_io_context()));
+    asio::io_context& ioc = pool.get_io_context();
     acceptor.async_accept(
-        new_conn_ptr->get_socket(), [this](std::error_code ec) {
+        ioc, [this, &ioc](std::error_code ec, asio::ip::tcp::socket socket) {
             if (!ec) {
-                this->new_conn_ptr->set_timeout(this->conn_timeout);
-                this->new_conn_ptr->start();
+                // sessions are created on the thread running their io_context
+                asio::post(ioc, std::bind(&Socks5Server::start_session, this,
+                                          std::ref(ioc), std::move(socket)));
             } else if (ec != asio::error::operation_aborted) {
                 SPDLOG_DEBUG("Failed to Accept Connection : {}", ec.message());
             }
 
             do_accept();
         });
+}
+
+void Socks5Server::start_session(asio::io_context& ioc,
+                                 asio::ip::tcp::socket& socket) {
+#ifdef SOCKS_COROUTINE_SESSION
+    asio::co_spawn(
+        ioc,
+        Socks5CoroutineSession::run(
+            std::move(socket),
+            ServerParser::global_config()->get_conn_timeout()),
+        asio::detached);
+#else
+    auto session =
+        asio::use_service<Socks5SessionPool>(ioc).acquire(std::move(socket));
+    session->set_timeout(ServerParser::global_config()->get_conn_timeout());
+    session->start();
+#endif
 }
\ No newline at end of file
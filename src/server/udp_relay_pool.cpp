@@ -0,0 +1,304 @@
+#include "server/udp_relay_pool.h"
+
+#include <algorithm>
+
+#include "option/parser.h"
+#include "session/socks5_session.h"
+
+namespace {
+
+// largest datagram the relay accepts
+const size_t udp_relay_buffer_size = 65536;
+
+// datagrams from IPv4 clients arrive as v4-mapped addresses on IPv6 relays
+asio::ip::address normalize_address(const asio::ip::address& address,
+                                    const asio::ip::udp& protocol) {
+    if (protocol == asio::ip::udp::v4()) {
+        if (address.is_v6() && address.to_v6().is_v4_mapped()) {
+            return asio::ip::make_address_v4(asio::ip::v4_mapped,
+                                             address.to_v6());
+        }
+    } else if (address.is_v4()) {
+        return asio::ip::make_address_v6(asio::ip::v4_mapped,
+                                         address.to_v4());
+    }
+    return address;
+}
+
+}    // namespace
+
+UdpRelaySocket::UdpRelaySocket(asio::io_context& ioc,
+                               const asio::ip::udp& protocol, bool shared)
+    : shared(shared),
+      held(false),
+      stats(asio::use_service<worker_metrics>(ioc)),
+      socket(ioc, asio::ip::udp::endpoint(protocol, 0)),
+      local_endpoint(socket.local_endpoint()),
+      length(0),
+      buffer(udp_relay_buffer_size),
+      any_client(nullptr) {}
+
+void UdpRelaySocket::start() { this->do_receive(); }
+
+void UdpRelaySocket::close() {
+    asio::error_code ignored_ec;
+    this->socket.close(ignored_ec);
+    this->held = false;
+    this->any_client = nullptr;
+    this->clients.clear();
+    this->pending_clients.clear();
+    this->servers.clear();
+}
+
+void UdpRelaySocket::bind_client(const asio::ip::udp::endpoint& endpoint,
+                                 Socks5Session* session) {
+    this->clients.emplace(
+        asio::ip::udp::endpoint(
+            normalize_address(endpoint.address(), local_endpoint.protocol()),
+            endpoint.port()),
+        session);
+}
+
+void UdpRelaySocket::unbind_client(const asio::ip::udp::endpoint& endpoint,
+                                   Socks5Session* session) {
+    auto iter = this->clients.find(asio::ip::udp::endpoint(
+        normalize_address(endpoint.address(), local_endpoint.protocol()),
+        endpoint.port()));
+    if (iter != this->clients.end() && iter->second == session) {
+        this->clients.erase(iter);
+    }
+}
+
+void UdpRelaySocket::bind_client_address(const asio::ip::address& address,
+                                         Socks5Session* session) {
+    this->pending_clients.emplace(
+        normalize_address(address, local_endpoint.protocol()), session);
+}
+
+void UdpRelaySocket::unbind_client_address(const asio::ip::address& address,
+                                           Socks5Session* session) {
+    auto range = this->pending_clients.equal_range(
+        normalize_address(address, local_endpoint.protocol()));
+    for (auto iter = range.first; iter != range.second; ++iter) {
+        if (iter->second == session) {
+            this->pending_clients.erase(iter);
+            return;
+        }
+    }
+}
+
+void UdpRelaySocket::bind_any_client(Socks5Session* session) {
+    this->any_client = session;
+}
+
+bool UdpRelaySocket::bind_server(const asio::ip::udp::endpoint& endpoint,
+                                 Socks5Session* session) {
+    auto result = this->servers.emplace(endpoint, session);
+    return result.first->second == session;
+}
+
+void UdpRelaySocket::unbind_server(const asio::ip::udp::endpoint& endpoint,
+                                   Socks5Session* session) {
+    auto iter = this->servers.find(endpoint);
+    if (iter != this->servers.end() && iter->second == session) {
+        this->servers.erase(iter);
+    }
+}
+
+void UdpRelaySocket::resume() {
+    if (!this->held || !this->socket.is_open()) {
+        return;
+    }
+
+    this->held = false;
+    if (this->dispatch()) {
+        this->do_receive();
+    } else {
+        this->held = true;
+    }
+}
+
+void UdpRelaySocket::do_receive() {
+    udp_relay_ptr self(this);
+    this->socket.async_receive_from(
+        asio::buffer(this->buffer.data(), this->buffer.size()),
+        this->sender_endpoint,
+        [this, self](asio::error_code ec, size_t length) {
+            // closed while the completion was queued
+            if (!this->socket.is_open()) {
+                return;
+            }
+
+            if (!ec) {
+                this->length = length;
+
+                // a private relay stops reading until its association is
+                // ready, a shared relay must not stall the other associations
+                if (!this->dispatch()) {
+                    if (!this->shared) {
+                        this->held = true;
+                        return;
+                    }
+
+                    this->stats.add(metric::udp_dropped_datagrams);
+                    SPDLOG_TRACE("UDP Relay {} Dropped Datagram From {}",
+                                 this->local_endpoint, this->sender_endpoint);
+                }
+
+                this->do_receive();
+            } else if (ec != asio::error::operation_aborted) {
+                SPDLOG_WARN("UDP Relay {} Failed to Receive, ERR_MSG = [{}]",
+                            this->local_endpoint, ec.message());
+                this->do_receive();
+            }
+        });
+}
+
+bool UdpRelaySocket::dispatch() {
+    auto client = this->clients.find(this->sender_endpoint);
+    if (client != this->clients.end()) {
+        return client->second->on_udp_client_message(
+            *this, this->sender_endpoint, this->buffer.data(), this->length);
+    }
+
+    auto server = this->servers.find(this->sender_endpoint);
+    if (server != this->servers.end()) {
+        return server->second->on_udp_server_message(
+            this->sender_endpoint, this->buffer.data(), this->length);
+    }
+
+    auto pending = this->pending_clients.find(this->sender_endpoint.address());
+    if (pending != this->pending_clients.end()) {
+        return pending->second->on_udp_client_message(
+            *this, this->sender_endpoint, this->buffer.data(), this->length);
+    }
+
+    if (this->any_client != nullptr) {
+        return this->any_client->on_udp_client_message(
+            *this, this->sender_endpoint, this->buffer.data(), this->length);
+    }
+
+    // unkown vistor (ignore)
+    return true;
+}
+
+asio::execution_context::id UdpRelayPool::id;
+
+UdpRelayPool::UdpRelayPool(asio::io_context& ioc)
+    : asio::execution_context::service(ioc),
+      ioc(ioc),
+      pool_size(ServerParser::global_config()->get_udp_relay_sockets()),
+      next_v4_relay(0),
+      next_v6_relay(0) {
+    if (pool_size == 0) pool_size = 1;
+}
+
+UdpRelayPool::~UdpRelayPool() { this->shutdown(); }
+
+udp_relay_ptr UdpRelayPool::acquire(const asio::ip::udp& protocol) {
+    auto& relays = this->get_relays(protocol);
+    size_t& next_relay = (protocol == asio::ip::udp::v4()) ? next_v4_relay
+                                                             : next_v6_relay;
+
+    auto relay = relays[next_relay];
+    ++next_relay;
+    if (next_relay == relays.size()) {
+        next_relay = 0;
+    }
+    return relay;
+}
+
+const std::vector<udp_relay_ptr>& UdpRelayPool::get_relays(
+    const asio::ip::udp& protocol) {
+    auto& relays =
+        (protocol == asio::ip::udp::v4()) ? v4_relays : v6_relays;
+    if (relays.empty()) {
+        this->open_relays(relays, protocol);
+    }
+    return relays;
+}
+
+udp_relay_ptr UdpRelayPool::bind_server(const asio::ip::udp::endpoint& server,
+                                        Socks5Session* session,
+                                        const udp_relay_ptr& preferred) {
+    auto protocol = server.protocol();
+    auto can_bind = [&server, session, &protocol](const udp_relay_ptr& relay) {
+        return relay->get_local_endpoint().protocol() == protocol &&
+               relay->bind_server(server, session);
+    };
+
+    if (preferred && can_bind(preferred)) {
+        return preferred;
+    }
+    for (auto&& relay : this->get_relays(protocol)) {
+        if (can_bind(relay)) {
+            return relay;
+        }
+    }
+    auto& extra_relays = (protocol == asio::ip::udp::v4()) ? extra_v4_relays
+                                                           : extra_v6_relays;
+    for (auto&& relay : extra_relays) {
+        if (can_bind(relay)) {
+            return relay;
+        }
+    }
+
+    // every relay socket already serves this server for another association
+    try {
+        udp_relay_ptr relay(new UdpRelaySocket(this->ioc, protocol, true));
+        relay->start();
+        relay->bind_server(server, session);
+        extra_relays.push_back(relay);
+        SPDLOG_DEBUG("UDP Relay Socket Listening on {}, {} Extra Relays",
+                     relay->get_local_endpoint(), extra_relays.size());
+        return relay;
+    } catch (const asio::system_error& e) {
+        SPDLOG_WARN("Failed to open UDP relay socket, ERR_MSG = [{}]",
+                    std::string(e.what()));
+    }
+    return udp_relay_ptr();
+}
+
+void UdpRelayPool::unbind_server(const udp_relay_ptr& relay,
+                                 const asio::ip::udp::endpoint& server,
+                                 Socks5Session* session) {
+    relay->unbind_server(server, session);
+    if (relay->serves_servers()) {
+        return;
+    }
+
+    auto& extra_relays =
+        (relay->get_local_endpoint().protocol() == asio::ip::udp::v4())
+            ? extra_v4_relays
+            : extra_v6_relays;
+    auto iter = std::find(extra_relays.begin(), extra_relays.end(), relay);
+    if (iter != extra_relays.end()) {
+        relay->close();
+        extra_relays.erase(iter);
+    }
+}
+
+void UdpRelayPool::shutdown() {
+    for (auto* relays :
+         {&v4_relays, &v6_relays, &extra_v4_relays, &extra_v6_relays}) {
+        for (auto&& relay : *relays) {
+            relay->close();
+        }
+        relays->clear();
+    }
+}
+
+void UdpRelayPool::open_relays(std::vector<udp_relay_ptr>& relays,
+                               const asio::ip::udp& protocol) {
+    std::vector<udp_relay_ptr> opened;
+    for (size_t i = 0; i < pool_size; i++) {
+        opened.emplace_back(new UdpRelaySocket(this->ioc, protocol, true));
+    }
+
+    for (auto&& relay : opened) {
+        relay->start();
+        SPDLOG_DEBUG("UDP Relay Socket Listening on {}",
+                     relay->get_local_endpoint());
+    }
+    relays.swap(opened);
+}
\ No newline at end of file
@@ -0,0 +1,795 @@
+#ifdef SOCKS_COROUTINE_SESSION
+
+#include "session/socks5_coroutine_session.h"
+
+#include "asio/experimental/awaitable_operators.hpp"
+#include "util/auth_cache.h"
+
+using namespace asio::experimental::awaitable_operators;
+
+namespace {
+
+// errors are returned as the first element of a tuple instead of thrown,
+// used wherever an error is an expected end of the session
+constexpr auto use_nothrow_awaitable = asio::as_tuple(asio::use_awaitable);
+
+// largest datagram the relay accepts
+const size_t udp_relay_buffer_size = 65536;
+
+// room kept in front of a received datagram for the UDP request header
+// (RSV, FRAG, ATYP, IPv6 DST.ADDR and DST.PORT)
+const size_t udp_header_space = 22;
+
+asio::ip::address make_address(const std::vector<uint8_t>& addr) {
+    if (addr.size() == 4) {
+        asio::ip::address_v4::bytes_type bytes;
+        std::memcpy(bytes.data(), addr.data(), bytes.size());
+        return asio::ip::address_v4(bytes);
+    }
+
+    asio::ip::address_v6::bytes_type bytes;
+    std::memcpy(bytes.data(), addr.data(), bytes.size());
+    return asio::ip::address_v6(bytes);
+}
+
+}    // namespace
+
+asio::awaitable<void> Socks5CoroutineSession::run(asio::ip::tcp::socket socket,
+                                                  size_t timeout) {
+    Socks5CoroutineSession session(std::move(socket), timeout);
+    session.stats.add(metric::sessions_accepted);
+    session.stats.add(metric::sessions_active);
+
+    // whichever finishes first cancels the other
+    co_await (session.serve() || session.watchdog());
+    session.stop();
+    session.stats.sub(metric::sessions_active);
+    session.write_access_record();
+}
+
+Socks5CoroutineSession::Socks5CoroutineSession(asio::ip::tcp::socket&& socket,
+                                               size_t timeout)
+    : socket(std::move(socket)),
+      stats(asio::use_service<worker_metrics>(asio::query(
+          this->socket.get_executor(), asio::execution::context))),
+      access(asio::use_service<access_log>(asio::query(
+          this->socket.get_executor(), asio::execution::context))),
+      dst_socket(this->socket.get_executor()),
+      udp_socket(this->socket.get_executor()),
+      tcp_resolver(this->socket.get_executor()),
+      udp_resolver(this->socket.get_executor()),
+      deadline(this->socket.get_executor()),
+      timeout(timeout),
+      cli_text(tcp_cli_endpoint),
+      local_text(local_endpoint),
+      udp_client_bound(false),
+      ulen(0),
+      cmd(SocksV5::RequestCMD::Connect),
+      request_atyp(SocksV5::RequestATYP::Ipv4),
+      dst_port(0),
+      rep(SocksV5::ReplyREP::Succeeded),
+      accepted_at(std::chrono::steady_clock::now()),
+      phase_at(accepted_at),
+      client_bytes_read(0),
+      upstream_bytes_read(0),
+      request_read(false),
+      replied(false),
+      log_traced(false) {
+    deadline.expires_at(asio::steady_timer::time_point::max());
+}
+
+asio::awaitable<void> Socks5CoroutineSession::serve() {
+    try {
+        this->local_endpoint = this->socket.local_endpoint();
+        this->tcp_cli_endpoint = this->socket.remote_endpoint();
+        this->cli_text.clear();
+        this->local_text.clear();
+        this->log_traced = Logger::getInstance()->InDebugScope(
+            this->tcp_cli_endpoint.address(), nullptr, 0);
+
+        SESSION_DEBUG("New Client Connection {}", this->cli_text);
+
+        asio::error_code ec;
+        ServerParser::global_config()->get_client_socket_options().apply(
+            this->socket, ec);
+        if (ec) {
+            SESSION_DEBUG("Failed to Set Client {} Socket Options : {}",
+                          this->cli_text, ec.message());
+        }
+
+        this->keep_alive();
+
+        if (!co_await this->negotiate_method() ||
+            !co_await this->read_request()) {
+            co_return;
+        }
+
+        switch (this->cmd) {
+            case SocksV5::RequestCMD::Connect: {
+                co_await this->do_connect();
+            } break;
+
+            case SocksV5::RequestCMD::UdpAssociate: {
+                co_await this->do_udp_associate();
+            } break;
+
+            default: {
+                co_await this->reply_error(
+                    SocksV5::ReplyREP::CommandNotSupported);
+            } break;
+        }
+    } catch (const asio::system_error& e) {
+        SESSION_DEBUG("Client {} Closed, ERR_MSG = [{}]", this->cli_text,
+                      e.code().message());
+    }
+}
+
+asio::awaitable<void> Socks5CoroutineSession::watchdog() {
+    for (;;) {
+        co_await this->deadline.async_wait(use_nothrow_awaitable);
+
+        if ((co_await asio::this_coro::cancellation_state).cancelled() !=
+            asio::cancellation_type::none) {
+            co_return;
+        }
+
+        // keep_alive moved the expiry and aborted the wait
+        if (this->deadline.expiry() <= asio::steady_timer::clock_type::now()) {
+            SESSION_DEBUG("Client {} Timeout", this->cli_text);
+            co_return;
+        }
+    }
+}
+
+void Socks5CoroutineSession::keep_alive() {
+    if (this->timeout > 0) {
+        this->deadline.expires_after(asio::chrono::seconds(this->timeout));
+    }
+}
+
+void Socks5CoroutineSession::record_phase(latency phase) {
+    auto now = std::chrono::steady_clock::now();
+    this->stats.observe(phase, now - this->phase_at);
+    this->phase_at = now;
+}
+
+void Socks5CoroutineSession::write_access_record() {
+    access_record* record = this->access.prepare();
+    if (record == nullptr) {
+        return;
+    }
+
+    record->set_times(this->accepted_at);
+    record->client_bytes = this->client_bytes_read;
+    record->upstream_bytes = this->upstream_bytes_read;
+    record->set_client(this->tcp_cli_endpoint);
+    record->set_username(this->uname, this->ulen);
+    if (this->request_read) {
+        record->cmd = static_cast<uint8_t>(this->cmd);
+        record->set_destination(static_cast<uint8_t>(this->request_atyp),
+                                this->dst_addr, this->dst_port);
+    } else {
+        record->cmd = access_record::none;
+        record->dst_atyp = access_record::none;
+        record->dst_length = 0;
+        record->dst_port = 0;
+    }
+    record->rep =
+        this->replied ? static_cast<uint8_t>(this->rep) : access_record::none;
+    this->access.commit();
+}
+
+void Socks5CoroutineSession::stop() {
+    asio::error_code ignored_ec;
+    this->socket.close(ignored_ec);
+    this->dst_socket.close(ignored_ec);
+    this->udp_socket.close(ignored_ec);
+    this->deadline.cancel(ignored_ec);
+}
+
+SocksV5::Method Socks5CoroutineSession::choose_method() {
+    for (auto&& method : this->methods) {
+        if (ServerParser::global_config()->is_supported_method(method)) {
+            return method;
+        }
+    }
+    return SocksV5::Method::NoAcceptable;
+}
+
+asio::awaitable<bool> Socks5CoroutineSession::negotiate_method() {
+    // VER | NMETHODS
+    uint8_t header[2];
+    co_await asio::async_read(this->socket, asio::buffer(header),
+                              asio::use_awaitable);
+
+    if (header[0] != static_cast<uint8_t>(SocksVersion::V5)) {
+        SESSION_DEBUG("Unsupported protocol version");
+        this->stats.add(metric::failed_version);
+        co_return false;
+    }
+
+    this->methods.resize(header[1]);
+    co_await asio::async_read(this->socket, asio::buffer(this->methods),
+                              asio::use_awaitable);
+    this->record_phase(latency::greeting);
+
+    // VER | METHOD
+    SocksV5::Method method = this->choose_method();
+    uint8_t reply[2] = {header[0], static_cast<uint8_t>(method)};
+    co_await asio::async_write(this->socket, asio::buffer(reply),
+                               asio::use_awaitable);
+
+    SESSION_DEBUG("Proxy {} -> Client {} DATA : [METHOD = X'{:02x}']",
+                  this->local_text, this->cli_text,
+                  static_cast<int16_t>(method));
+
+    switch (method) {
+        case SocksV5::Method::NoAuth:
+            co_return true;
+
+        case SocksV5::Method::UserPassWd:
+            co_return co_await this->authenticate();
+
+        default:
+            this->stats.add(metric::failed_method);
+            co_return false;
+    }
+}
+
+asio::awaitable<bool> Socks5CoroutineSession::authenticate() {
+    // VER | ULEN | UNAME | PLEN | PASSWD
+    uint8_t header[2];
+    co_await asio::async_read(this->socket, asio::buffer(header),
+                              asio::use_awaitable);
+
+    this->ulen = header[1];
+    co_await asio::async_read(this->socket,
+                              asio::buffer(this->uname, this->ulen),
+                              asio::use_awaitable);
+    this->log_traced = Logger::getInstance()->InDebugScope(
+        this->tcp_cli_endpoint.address(), this->uname, this->ulen);
+
+    uint8_t plen = 0;
+    co_await asio::async_read(this->socket, asio::buffer(&plen, 1),
+                              asio::use_awaitable);
+
+    // PLEN is a single byte, the password fits in the frame
+    uint8_t passwd[255];
+    co_await asio::async_read(this->socket, asio::buffer(passwd, plen),
+                              asio::use_awaitable);
+
+    bool success =
+        asio::use_service<auth_cache>(
+            asio::query(this->socket.get_executor(), asio::execution::context))
+            .check(*ServerParser::global_config(), this->uname, this->ulen,
+                   passwd, plen);
+
+    if (!success) {
+        this->stats.add(metric::failed_auth);
+    }
+    this->record_phase(latency::auth);
+
+    // VER | STATUS
+    auto status = success ? SocksV5::ReplyAuthStatus::Success
+                          : SocksV5::ReplyAuthStatus::Failure;
+    uint8_t reply[2] = {header[0], static_cast<uint8_t>(status)};
+    co_await asio::async_write(this->socket, asio::buffer(reply),
+                               asio::use_awaitable);
+
+    SESSION_DEBUG(
+        "Proxy {} -> Client {} DATA : [UNAME = {}, STATUS = X'{:02x}']",
+        this->local_text, this->cli_text,
+        std::string(this->uname, this->uname + this->ulen),
+        static_cast<int16_t>(status));
+
+    co_return success;
+}
+
+asio::awaitable<bool> Socks5CoroutineSession::read_request() {
+    // VER | CMD | RSV | ATYP
+    uint8_t header[4];
+    co_await asio::async_read(this->socket, asio::buffer(header),
+                              asio::use_awaitable);
+
+    this->cmd = static_cast<SocksV5::RequestCMD>(header[1]);
+    this->request_atyp = static_cast<SocksV5::RequestATYP>(header[3]);
+
+    switch (this->request_atyp) {
+        case SocksV5::RequestATYP::Ipv4: {
+            this->dst_addr.resize(4);
+        } break;
+
+        case SocksV5::RequestATYP::Ipv6: {
+            this->dst_addr.resize(16);
+        } break;
+
+        case SocksV5::RequestATYP::DoMainName: {
+            uint8_t length = 0;
+            co_await asio::async_read(this->socket, asio::buffer(&length, 1),
+                                      asio::use_awaitable);
+            this->dst_addr.resize(length);
+        } break;
+
+        default: {
+            SPDLOG_WARN("Unkown Request Atyp");
+            co_await this->reply_error(SocksV5::ReplyREP::AddrTypeNotSupported);
+            co_return false;
+        }
+    }
+
+    // DST.ADDR | DST.PORT
+    std::array<asio::mutable_buffer, 2> buf = {
+        {asio::buffer(this->dst_addr), asio::buffer(&this->dst_port, 2)}};
+    co_await asio::async_read(this->socket, buf, asio::use_awaitable);
+
+    // network octet order convert to host octet order
+    this->dst_port = ntohs(this->dst_port);
+    this->record_phase(latency::request);
+    this->request_read = true;
+
+    SESSION_DEBUG(
+        "Client {} -> Proxy {} DATA : [CMD = X'{:02x}', DST.ADDR = {}, "
+        "DST.PORT = {}]",
+        this->cli_text, this->local_text,
+        static_cast<int16_t>(this->cmd),
+        convert::dst_to_string(this->dst_addr,
+                               static_cast<ATyp>(this->request_atyp)),
+        this->dst_port);
+
+    co_return true;
+}
+
+template <typename InternetProtocol>
+asio::awaitable<void> Socks5CoroutineSession::reply(
+    SocksV5::ReplyREP rep,
+    const asio::ip::basic_endpoint<InternetProtocol>& endpoint) {
+    // VER | REP | RSV | ATYP | BND.ADDR | BND.PORT
+    std::array<uint8_t, 22> buf = {{static_cast<uint8_t>(SocksVersion::V5),
+                                    static_cast<uint8_t>(rep), 0x00}};
+    size_t length = 4;
+    this->rep = rep;
+    this->replied = true;
+
+    if (endpoint.address().is_v4()) {
+        buf[3] = static_cast<uint8_t>(SocksV5::ReplyATYP::Ipv4);
+        auto&& bytes = endpoint.address().to_v4().to_bytes();
+        std::memcpy(buf.data() + length, bytes.data(), bytes.size());
+        length += bytes.size();
+    } else {
+        buf[3] = static_cast<uint8_t>(SocksV5::ReplyATYP::Ipv6);
+        auto&& bytes = endpoint.address().to_v6().to_bytes();
+        std::memcpy(buf.data() + length, bytes.data(), bytes.size());
+        length += bytes.size();
+    }
+
+    buf[length++] = static_cast<uint8_t>(endpoint.port() >> 8);
+    buf[length++] = static_cast<uint8_t>(endpoint.port() & 0xff);
+
+    co_await asio::async_write(this->socket, asio::buffer(buf.data(), length),
+                               asio::use_awaitable);
+
+    SESSION_DEBUG(
+        "Proxy {} -> Client {} DATA : [REP = X'{:02x}', BND.ADDR = {}, "
+        "BND.PORT = {}]",
+        this->local_text, this->cli_text, static_cast<int16_t>(rep),
+        endpoint.address().to_string(), endpoint.port());
+}
+
+asio::awaitable<void> Socks5CoroutineSession::reply_error(
+    SocksV5::ReplyREP rep) {
+    this->stats.add_failure(rep);
+    co_await this->reply(
+        rep, asio::ip::tcp::endpoint(asio::ip::address_v4::any(), 0));
+}
+
+asio::awaitable<void> Socks5CoroutineSession::do_connect() {
+    if (this->request_atyp == SocksV5::RequestATYP::DoMainName) {
+        std::string domain =
+            convert::dst_to_string(this->dst_addr, ATyp::DoMainName);
+
+        this->stats.add(metric::dns_lookups);
+        auto [ec, results] = co_await this->tcp_resolver.async_resolve(
+            domain, std::to_string(this->dst_port), use_nothrow_awaitable);
+        if (ec) {
+            this->stats.add(metric::dns_failures);
+            SPDLOG_WARN("Failed to Reslove Domain {}, ERR_MSG = [{}]", domain,
+                        ec.message());
+            co_await this->reply_error(SocksV5::ReplyREP::HostUnreachable);
+            co_return;
+        }
+
+        SESSION_DEBUG("Reslove Domain {} {} result sets in total", domain,
+                      results.size());
+        this->record_phase(latency::resolve);
+
+        // try each endpoint in turn
+        auto [connect_ec, endpoint] = co_await asio::async_connect(
+            this->dst_socket, results, use_nothrow_awaitable);
+        if (connect_ec) {
+            co_await this->reply_error(SocksV5::ReplyREP::NetworkUnreachable);
+            co_return;
+        }
+        this->tcp_dst_endpoint = endpoint;
+    } else {
+        this->tcp_dst_endpoint = asio::ip::tcp::endpoint(
+            make_address(this->dst_addr), this->dst_port);
+
+        auto [connect_ec] = co_await this->dst_socket.async_connect(
+            this->tcp_dst_endpoint, use_nothrow_awaitable);
+        if (connect_ec) {
+            SESSION_DEBUG("Server {} Connection Failed",
+                          this->tcp_dst_endpoint);
+            co_await this->reply_error(SocksV5::ReplyREP::ConnRefused);
+            co_return;
+        }
+    }
+
+    this->record_phase(latency::connect);
+    this->connected_at = this->phase_at;
+
+    // the range connect reopens the socket for every endpoint, so the
+    // options are set once the connection is established
+    asio::error_code ec;
+    ServerParser::global_config()->get_upstream_socket_options().apply(
+        this->dst_socket, ec);
+    if (ec) {
+        SESSION_DEBUG("Failed to Set Upstream {} Socket Options : {}",
+                      this->tcp_dst_endpoint, ec.message());
+    }
+
+    this->tcp_bnd_endpoint = this->dst_socket.local_endpoint();
+
+    SESSION_DEBUG("Proxy {} -> Server {} Connection Successed",
+                  this->tcp_bnd_endpoint, this->tcp_dst_endpoint);
+
+    co_await this->reply(SocksV5::ReplyREP::Succeeded, this->tcp_bnd_endpoint);
+
+    auto now = std::chrono::steady_clock::now();
+    this->stats.observe(latency::reply, now - this->connected_at);
+    this->stats.observe(latency::setup, now - this->accepted_at);
+
+    this->client_buffer.resize(BUFSIZ);
+    this->dst_buffer.resize(BUFSIZ);
+
+    this->keep_alive();
+
+    co_await (
+        this->relay(this->socket, this->dst_socket, this->client_buffer) &&
+        this->relay(this->dst_socket, this->socket, this->dst_buffer));
+}
+
+asio::awaitable<void> Socks5CoroutineSession::relay(
+    asio::ip::tcp::socket& from, asio::ip::tcp::socket& to,
+    std::vector<uint8_t>& buffer) {
+    metric bytes = (&from == &this->socket) ? metric::client_bytes
+                                            : metric::upstream_bytes;
+    uint64_t& bytes_read = (&from == &this->socket)
+                               ? this->client_bytes_read
+                               : this->upstream_bytes_read;
+    // time to first byte is measured on the server to client relay only
+    bool first_byte_seen = (&from == &this->socket);
+    for (;;) {
+        auto [ec, length] = co_await from.async_read_some(
+            asio::buffer(buffer.data(), buffer.size()), use_nothrow_awaitable);
+        if (ec == asio::error::eof) {
+            // the other direction keeps flowing until it ends as well
+            asio::error_code ignored_ec;
+            to.shutdown(asio::ip::tcp::socket::shutdown_send, ignored_ec);
+            co_return;
+        }
+        if (ec) {
+            break;
+        }
+
+        this->stats.add(bytes, length);
+        bytes_read += length;
+        if (!first_byte_seen) {
+            first_byte_seen = true;
+            this->stats.observe(latency::first_byte,
+                                std::chrono::steady_clock::now() -
+                                    this->connected_at);
+        }
+        this->keep_alive();
+
+        auto [write_ec, write_length] = co_await asio::async_write(
+            to, asio::buffer(buffer.data(), length), use_nothrow_awaitable);
+        if (write_ec) {
+            break;
+        }
+
+        this->keep_alive();
+    }
+
+    SESSION_TRACE("Client {} Relay Closed", this->cli_text);
+
+    // ends the relay in the other direction
+    this->stop();
+}
+
+asio::awaitable<void> Socks5CoroutineSession::do_udp_associate() {
+    if (this->request_atyp == SocksV5::RequestATYP::DoMainName) {
+        std::string domain =
+            convert::dst_to_string(this->dst_addr, ATyp::DoMainName);
+
+        this->stats.add(metric::dns_lookups);
+        auto [ec, results] = co_await this->udp_resolver.async_resolve(
+            domain, std::to_string(this->dst_port), use_nothrow_awaitable);
+        if (ec) {
+            this->stats.add(metric::dns_failures);
+            SPDLOG_WARN("Failed to Reslove Domain {}, ERR_MSG = [{}]", domain,
+                        ec.message());
+            co_await this->reply_error(SocksV5::ReplyREP::HostUnreachable);
+            co_return;
+        }
+
+        // use first endpoint
+        this->udp_cli_endpoint = results.begin()->endpoint();
+        for (auto&& entry : results) {
+            this->udp_client_endpoints.push_back(entry.endpoint());
+        }
+    } else {
+        this->udp_cli_endpoint = asio::ip::udp::endpoint(
+            make_address(this->dst_addr), this->dst_port);
+
+        // all zeros : the client is not in possesion of its address yet
+        if (!this->udp_cli_endpoint.address().is_unspecified()) {
+            this->udp_client_endpoints.push_back(this->udp_cli_endpoint);
+        }
+    }
+
+    auto protocol = this->udp_cli_endpoint.protocol();
+    asio::error_code ec;
+    this->udp_socket.open(protocol, ec);
+    if (!ec) {
+        this->udp_socket.bind(asio::ip::udp::endpoint(protocol, 0), ec);
+    }
+    if (!ec) {
+        this->udp_bnd_endpoint = this->udp_socket.local_endpoint(ec);
+    }
+    if (ec) {
+        SPDLOG_WARN("Failed to reply udp associate, ERR_MSG = [{}]",
+                    ec.message());
+        co_await this->reply_error(SocksV5::ReplyREP::GenServFailed);
+        co_return;
+    }
+
+    co_await this->reply(SocksV5::ReplyREP::Succeeded, this->udp_bnd_endpoint);
+
+    this->client_buffer.resize(udp_header_space + udp_relay_buffer_size);
+    // the TCP connection carries no more data, anything read is discarded
+    this->dst_buffer.resize(64);
+
+    co_await (this->wait_udp_control() || this->relay_udp());
+}
+
+asio::awaitable<void> Socks5CoroutineSession::wait_udp_control() {
+    for (;;) {
+        auto [ec, length] = co_await this->socket.async_read_some(
+            asio::buffer(this->dst_buffer.data(), this->dst_buffer.size()),
+            use_nothrow_awaitable);
+        if (ec) {
+            SESSION_DEBUG("Client {} Closed", this->cli_text);
+            co_return;
+        }
+    }
+}
+
+asio::awaitable<void> Socks5CoroutineSession::relay_udp() {
+    uint8_t* data = this->client_buffer.data() + udp_header_space;
+    asio::ip::udp::endpoint sender;
+
+    for (;;) {
+        auto [ec, length] = co_await this->udp_socket.async_receive_from(
+            asio::buffer(data, udp_relay_buffer_size), sender,
+            use_nothrow_awaitable);
+        if (ec == asio::error::operation_aborted) {
+            co_return;
+        } else if (ec) {
+            SPDLOG_WARN("UDP Relay {} Failed to Receive, ERR_MSG = [{}]",
+                        this->udp_bnd_endpoint, ec.message());
+            continue;
+        }
+
+        if (this->check_udp_client(sender)) {
+            SESSION_TRACE("UDP Client {} -> Proxy {} Data Length = {}", sender,
+                          this->udp_bnd_endpoint, length);
+
+            this->stats.add(metric::udp_client_datagrams);
+            this->keep_alive();
+            if (!co_await this->send_udp_to_dst(data, length)) {
+                co_return;
+            }
+        } else if (sender == this->udp_dst_endpoint) {
+            SESSION_TRACE("UDP Server {} -> Proxy {} Data Length = {}", sender,
+                          this->udp_bnd_endpoint, length);
+
+            this->stats.add(metric::udp_upstream_datagrams);
+            this->keep_alive();
+            co_await this->send_udp_to_client(data, length);
+        }
+
+        // unkown vistor (ignore)
+    }
+}
+
+bool Socks5CoroutineSession::check_udp_client(
+    const asio::ip::udp::endpoint& sender) {
+    if (this->udp_client_bound) {
+        return sender == this->udp_cli_endpoint;
+    }
+
+    // the client port may be unknown, the first datagram from the address
+    // binds its sender endpoint
+    if (!this->udp_client_endpoints.empty() &&
+        std::none_of(this->udp_client_endpoints.begin(),
+                     this->udp_client_endpoints.end(),
+                     [&sender](const asio::ip::udp::endpoint& endpoint) {
+                         return endpoint.port() == 0
+                                    ? endpoint.address() == sender.address()
+                                    : endpoint == sender;
+                     })) {
+        return false;
+    }
+
+    this->udp_cli_endpoint = sender;
+    this->udp_client_bound = true;
+    return true;
+}
+
+asio::awaitable<bool> Socks5CoroutineSession::send_udp_to_dst(uint8_t* data,
+                                                              size_t length) {
+    //  RSV | FRAG | ATYP | DST.ADDR | DST.PORT | DATA
+    if (length <= 4) {
+        SPDLOG_WARN("Udp Associate Header Length Error");
+        co_return false;
+    }
+
+    if (data[0] != 0 || data[1] != 0) {
+        SPDLOG_WARN("Udp Associate RSV Not Zero");
+        co_return false;
+    }
+
+    // an implementation that does not support fragmentation MUST drop any
+    // datagram whose FRAG field is other than X'00'
+    if (data[2] != 0) {
+        SESSION_TRACE("Udp Associate Fragment Dropped");
+        co_return true;
+    }
+
+    size_t header_length = 0;
+    asio::ip::udp::endpoint endpoint;
+
+    switch (static_cast<SocksV5::RequestATYP>(data[3])) {
+        case SocksV5::RequestATYP::Ipv4: {
+            header_length = 10;
+            if (length <= header_length) {
+                SPDLOG_WARN("Udp Associate Header Length Error");
+                co_return false;
+            }
+
+            asio::ip::address_v4::bytes_type bytes;
+            std::memcpy(bytes.data(), data + 4, bytes.size());
+            endpoint = asio::ip::udp::endpoint(
+                asio::ip::address_v4(bytes), (data[8] << 8) | data[9]);
+        } break;
+
+        case SocksV5::RequestATYP::Ipv6: {
+            header_length = 22;
+            if (length <= header_length) {
+                SPDLOG_WARN("Udp Associate Header Length Error");
+                co_return false;
+            }
+
+            asio::ip::address_v6::bytes_type bytes;
+            std::memcpy(bytes.data(), data + 4, bytes.size());
+            endpoint = asio::ip::udp::endpoint(
+                asio::ip::address_v6(bytes), (data[20] << 8) | data[21]);
+        } break;
+
+        case SocksV5::RequestATYP::DoMainName: {
+            header_length = 7 + data[4];
+            if (length <= header_length) {
+                SPDLOG_WARN("Udp Associate Header Length Error");
+                co_return false;
+            }
+
+            std::string domain(reinterpret_cast<char*>(data + 5), data[4]);
+            uint16_t port = (data[header_length - 2] << 8) |
+                            data[header_length - 1];
+
+            this->stats.add(metric::dns_lookups);
+            auto [ec, results] = co_await this->udp_resolver.async_resolve(
+                domain, std::to_string(port), use_nothrow_awaitable);
+            if (ec || results.empty()) {
+                this->stats.add(metric::dns_failures);
+                SPDLOG_WARN("Failed to Reslove Domain {}, ERR_MSG = [{}]",
+                            domain, ec.message());
+                co_return true;
+            }
+
+            endpoint = results.begin()->endpoint();
+            for (auto&& entry : results) {
+                if (entry.endpoint().protocol() ==
+                    this->udp_bnd_endpoint.protocol()) {
+                    endpoint = entry.endpoint();
+                    break;
+                }
+            }
+        } break;
+
+        default: {
+            SPDLOG_WARN("Udp Associate Unknown ATYP");
+            co_return false;
+        }
+    }
+
+    // IPv4 servers are reached through v4-mapped addresses on IPv6 relays
+    if (endpoint.address().is_v4() &&
+        this->udp_bnd_endpoint.address().is_v6()) {
+        endpoint.address(asio::ip::make_address_v6(
+            asio::ip::v4_mapped, endpoint.address().to_v4()));
+    } else if (endpoint.address().is_v6() &&
+               this->udp_bnd_endpoint.address().is_v4()) {
+        SESSION_TRACE("Udp Associate IPv6 Server Unreachable from {}",
+                      this->udp_bnd_endpoint);
+        co_return true;
+    }
+
+    this->udp_dst_endpoint = endpoint;
+
+    auto [ec, write_length] = co_await this->udp_socket.async_send_to(
+        asio::buffer(data + header_length, length - header_length),
+        this->udp_dst_endpoint, use_nothrow_awaitable);
+    if (ec) {
+        SPDLOG_WARN("Proxy {} -> Server {} Failed to Send, ERR_MSG = [{}]",
+                    this->udp_bnd_endpoint, this->udp_dst_endpoint,
+                    ec.message());
+    }
+
+    co_return true;
+}
+
+asio::awaitable<void> Socks5CoroutineSession::send_udp_to_client(
+    uint8_t* data, size_t length) {
+    asio::ip::address address = this->udp_dst_endpoint.address();
+    if (address.is_v6() && address.to_v6().is_v4_mapped()) {
+        address = asio::ip::make_address_v4(asio::ip::v4_mapped,
+                                             address.to_v6());
+    }
+
+    // the header goes into the room in front of the datagram
+    uint8_t* header = nullptr;
+    size_t header_length = 0;
+    if (address.is_v4()) {
+        header_length = 10;
+        header = data - header_length;
+        header[3] = static_cast<uint8_t>(SocksV5::ReplyATYP::Ipv4);
+        auto&& bytes = address.to_v4().to_bytes();
+        std::memcpy(header + 4, bytes.data(), bytes.size());
+    } else {
+        header_length = 22;
+        header = data - header_length;
+        header[3] = static_cast<uint8_t>(SocksV5::ReplyATYP::Ipv6);
+        auto&& bytes = address.to_v6().to_bytes();
+        std::memcpy(header + 4, bytes.data(), bytes.size());
+    }
+
+    header[0] = 0x00;
+    header[1] = 0x00;
+    header[2] = 0x00;
+    header[header_length - 2] =
+        static_cast<uint8_t>(this->udp_dst_endpoint.port() >> 8);
+    header[header_length - 1] =
+        static_cast<uint8_t>(this->udp_dst_endpoint.port() & 0xff);
+
+    auto [ec, write_length] = co_await this->udp_socket.async_send_to(
+        asio::buffer(header, header_length + length), this->udp_cli_endpoint,
+        use_nothrow_awaitable);
+    if (ec) {
+        SPDLOG_WARN("Proxy {} -> Client {} Failed to Send, ERR_MSG = [{}]",
+                    this->udp_bnd_endpoint, this->udp_cli_endpoint,
+                    ec.message());
+    }
+}
+
+#endif
\ No newline at end of file
@@ -1,23 +1,164 @@
 #include "session/socks5_session.h"
 
-Socks5Session::Socks5Session(asio::io_context& ioc_)
-    : ioc(ioc_),
+#include "session/socks5_session_pool.h"
+#include "util/auth_cache.h"
+#include "util/buffer_pool.h"
+
+namespace {
+
+// RFC 1928 : the reassembly timer MUST be no less than 5 seconds
+const size_t udp_reassembly_timeout = 5;
+
+// largest payload a single UDP datagram can carry, a reassembled datagram
+// with its RSV, FRAG and address header must fit in it
+const size_t udp_reassembly_max_size = 65507;
+
+// RSV and FRAG of a datagram to the client, replies are never fragmented
+const uint8_t udp_reply_prefix[3] = {0x00, 0x00, 0x00};
+
+// datagrams of each direction a busy association keeps, shared relay sockets
+// drop what does not fit
+const size_t udp_queue_length = 16;
+
+// seconds the endpoints of a destination name are reused for
+const size_t udp_resolve_cache_time = 30;
+
+}    // namespace
+
+Socks5Session::Socks5Session(asio::io_context& ioc_,
+                             Socks5SessionPool* pool_)
+    : ref_count(0),
+      pool(pool_),
+      ioc(ioc_),
+      stats(asio::use_service<worker_metrics>(ioc_)),
+      access(asio::use_service<access_log>(ioc_)),
       udp_resolver(ioc_),
       socket(ioc_),
       dst_socket(ioc_),
-      deadline(ioc_) {
+      cli_text(tcp_cli_endpoint),
+      local_text(local_endpoint),
+      deadline(ioc_),
+      udp_busy(true),
+      udp_client_queue(udp_queue_length),
+      udp_server_queue(udp_queue_length),
+      udp_client_turn(true),
+      udp_resolving(false),
+      udp_resolved(false),
+      udp_resolve_length(0),
+      udp_resolved_port(0),
+      frag_timer(ioc_),
+      frag_position(0),
+      shared_relay_buffers(false),
+      relay_buffer_size(0),
+      reply_state(ReplyState::None),
+      reply_timer(ioc_),
+      connect_reply_delay(0),
+      pending_dst_length(0),
+      client_relay_done(false),
+      dst_relay_done(false),
+      upstream_fast_open(false),
+      early_data_length(0),
+      early_data_sent(0),
+      zerocopy_threshold(0),
+      first_byte_seen(false),
+      client_bytes_read(0),
+      upstream_bytes_read(0),
+      request_read(false),
+      replied(false),
+      log_traced(false) {
     deadline.expires_at(asio::steady_timer::time_point::max());
 }
 
+Socks5Session::~Socks5Session() { this->release_udp_relay(); }
+
+void intrusive_ptr_release(Socks5Session* session) noexcept {
+    if (--session->ref_count == 0) {
+        session->stats.sub(metric::sessions_active);
+        session->write_access_record();
+        if (session->pool != nullptr) {
+            session->pool->release(session);
+        } else {
+            delete session;
+        }
+    }
+}
+
 asio::ip::tcp::socket& Socks5Session::get_socket() { return this->socket; }
 
+void Socks5Session::reset() {
+    this->stop();
+
+    // a lingering socket keeps its session through the error queue wait, a
+    // socket still open here gave up on its buffers, which are dropped below
+    // and never go back to the buffer pool
+    asio::error_code ignored_ec;
+    this->socket.close(ignored_ec);
+    this->dst_socket.close(ignored_ec);
+
+    // buffers keep their capacity for the next connection
+    this->deadline.expires_at(asio::steady_timer::time_point::max());
+    this->resolve_results = asio::ip::udp::resolver::results_type();
+    this->methods.clear();
+    this->uname.clear();
+    this->passwd.clear();
+    this->dst_addr.clear();
+    this->bnd_addr.clear();
+    this->udp_busy = true;
+    this->udp_client_queue.clear();
+    this->udp_server_queue.clear();
+    this->udp_resolving = false;
+    this->udp_resolved = false;
+    this->udp_resolve_results = asio::ip::udp::resolver::results_type();
+    this->udp_resolved_name.clear();
+    this->reply_state = ReplyState::None;
+    this->pending_dst_length = 0;
+    this->client_relay_done = false;
+    this->dst_relay_done = false;
+    this->early_data_length = 0;
+    this->early_data_sent = 0;
+    this->reset_udp_reassembly();
+    this->client_zerocopy.clear();
+    this->dst_zerocopy.clear();
+}
+
 void Socks5Session::start() {
+    // pooled sessions pick up a reloaded configuration
+    const ServerParser* config = ServerParser::global_config();
+    this->connect_reply_delay = config->get_connect_reply_delay();
+    this->upstream_fast_open = config->get_upstream_socket_options().fast_open;
+    this->zerocopy_threshold = config->get_zerocopy_threshold();
+    this->shared_relay_buffers = config->get_shared_relay_buffers();
+    this->relay_buffer_size = config->get_relay_buffer_size();
+    asio::use_service<buffer_pool>(this->ioc).set_buffer_size(
+        this->relay_buffer_size);
+
+    this->stats.add(metric::sessions_accepted);
+    this->stats.add(metric::sessions_active);
+    this->accepted_at = std::chrono::steady_clock::now();
+    this->phase_at = this->accepted_at;
+    this->first_byte_seen = false;
+    this->client_bytes_read = 0;
+    this->upstream_bytes_read = 0;
+    this->request_read = false;
+    this->replied = false;
+    this->log_traced = false;
+
     try {
         this->local_endpoint = socket.local_endpoint();
         this->tcp_cli_endpoint = socket.remote_endpoint();
-
-        SPDLOG_DEBUG("New Client Connection {}",
-                     convert::format_address(this->tcp_cli_endpoint));
+        this->cli_text.clear();
+        this->local_text.clear();
+        this->log_traced = Logger::getInstance()->InDebugScope(
+            this->tcp_cli_endpoint.address(), nullptr, 0);
+
+        SESSION_DEBUG("New Client Connection {}", this->cli_text);
+
+        asio::error_code ec;
+        config->get_client_socket_options().apply(this->socket, ec);
+        if (ec) {
+            SESSION_DEBUG("Failed to Set Client {} Socket Options : {}",
+                          this->cli_text, ec.message());
+        }
 
         this->check_deadline();
         this->keep_alive();
@@ -32,9 +173,44 @@ void Socks5Session::start() {
 void Socks5Session::stop() {
     asio::error_code ignored_ec;
     this->udp_resolver.cancel();
-    this->socket.close(ignored_ec);
-    this->dst_socket.close(ignored_ec);
+    this->close_relay_socket(this->socket, this->client_zerocopy);
+    this->close_relay_socket(this->dst_socket, this->dst_zerocopy);
     this->deadline.cancel(ignored_ec);
+    this->frag_timer.cancel(ignored_ec);
+    this->reply_timer.cancel(ignored_ec);
+    this->release_udp_relay();
+}
+
+void Socks5Session::record_phase(latency phase) {
+    auto now = std::chrono::steady_clock::now();
+    this->stats.observe(phase, now - this->phase_at);
+    this->phase_at = now;
+}
+
+void Socks5Session::write_access_record() {
+    access_record* record = this->access.prepare();
+    if (record == nullptr) {
+        return;
+    }
+
+    record->set_times(this->accepted_at);
+    record->client_bytes = this->client_bytes_read;
+    record->upstream_bytes = this->upstream_bytes_read;
+    record->set_client(this->tcp_cli_endpoint);
+    record->set_username(this->uname.data(), this->uname.size());
+    if (this->request_read) {
+        record->cmd = static_cast<uint8_t>(this->cmd);
+        record->set_destination(static_cast<uint8_t>(this->request_atyp),
+                                this->dst_addr, this->dst_port);
+    } else {
+        record->cmd = access_record::none;
+        record->dst_atyp = access_record::none;
+        record->dst_length = 0;
+        record->dst_port = 0;
+    }
+    record->rep =
+        this->replied ? static_cast<uint8_t>(this->rep) : access_record::none;
+    this->access.commit();
 }
 
 void Socks5Session::check_deadline() {
@@ -43,11 +219,13 @@ void Socks5Session::check_deadline() {
     }
 
     if (deadline.expiry() <= asio::steady_timer::clock_type::now()) {
-        SPDLOG_DEBUG("Client {} Timeout",
-                     convert::format_address(this->tcp_cli_endpoint));
+        SESSION_DEBUG("Client {} Timeout", this->cli_text);
+        // give up on buffers the kernel never released
+        this->client_zerocopy.clear();
+        this->dst_zerocopy.clear();
         this->stop();
     } else {
-        auto self = shared_from_this();
+        session_ptr self(this);
         deadline.async_wait(std::bind(&Socks5Session::check_deadline, self));
     }
 }
@@ -56,7 +234,7 @@ void Socks5Session::set_timeout(size_t second) { this->timeout = second; }
 
 void Socks5Session::keep_alive() {
     if (this->timeout > 0) {
-        SPDLOG_TRACE("Connection Keep Alive");
+        SESSION_TRACE("Connection Keep Alive");
         deadline.expires_after(asio::chrono::seconds(this->timeout));
     }
 }
@@ -65,34 +243,35 @@ void Socks5Session::get_version_and_nmethods() {
     std::array<asio::mutable_buffer, 2> buf = {
         {asio::buffer(&this->ver, 1), asio::buffer(&this->nmethods, 1)}};
 
-    auto self = shared_from_this();
+    session_ptr self(this);
     asio::async_read(
         this->socket, buf,
-        [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
-            if (!ec) {
-                SPDLOG_DEBUG(
-                    "Client {} -> Proxy {} DATA : [VER = "
-                    "X'{:02x}', "
-                    "NMETHODS = {}]",
-                    convert::format_address(this->tcp_cli_endpoint),
-                    convert::format_address(this->local_endpoint),
-                    static_cast<int16_t>(this->ver),
-                    static_cast<int16_t>(this->nmethods));
+        make_custom_alloc_handler(
+            this->client_handler_memory,
+            [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
+                if (!ec) {
+                    SESSION_DEBUG(
+                        "Client {} -> Proxy {} DATA : [VER = "
+                        "X'{:02x}', "
+                        "NMETHODS = {}]",
+                        this->cli_text, this->local_text,
+                        static_cast<int16_t>(this->ver),
+                        static_cast<int16_t>(this->nmethods));
+
+                    if (this->ver != SocksVersion::V5) {
+                        SESSION_DEBUG("Unsupported protocol version");
+                        this->stats.add(metric::failed_version);
+                        this->stop();
+                        return;
+                    }
 
-                if (this->ver != SocksVersion::V5) {
-                    SPDLOG_DEBUG("Unsupported protocol version");
+                    this->methods.resize(this->nmethods);
+                    this->get_methods_list();
+                } else {
+                    SESSION_DEBUG("Client {} Closed", this->cli_text);
                     this->stop();
-                    return;
                 }
-
-                this->methods.resize(this->nmethods);
-                this->get_methods_list();
-            } else {
-                SPDLOG_DEBUG("Client {} Closed",
-                             convert::format_address(this->tcp_cli_endpoint));
-                this->stop();
-            }
-        });
+            }));
 }
 
 std::string Socks5Session::methods_toString() {
@@ -110,24 +289,25 @@ std::string Socks5Session::methods_toString() {
 }
 
 void Socks5Session::get_methods_list() {
-    auto self = shared_from_this();
+    session_ptr self(this);
     asio::async_read(
         this->socket, asio::buffer(this->methods.data(), this->methods.size()),
-        [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
-            if (!ec) {
-                SPDLOG_DEBUG("Client {} -> Proxy {} DATA : [METHODS = {}]",
-                             convert::format_address(this->tcp_cli_endpoint),
-                             convert::format_address(this->local_endpoint),
-                             this->methods_toString());
-
-                this->method = this->choose_method();
-                this->reply_support_method();
-            } else {
-                SPDLOG_DEBUG("Client {} Closed",
-                             convert::format_address(this->tcp_cli_endpoint));
-                this->stop();
-            }
-        });
+        make_custom_alloc_handler(
+            this->client_handler_memory,
+            [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
+                if (!ec) {
+                    SESSION_DEBUG("Client {} -> Proxy {} DATA : [METHODS = {}]",
+                                  this->cli_text, this->local_text,
+                                  this->methods_toString());
+
+                    this->record_phase(latency::greeting);
+                    this->method = this->choose_method();
+                    this->reply_support_method();
+                } else {
+                    SESSION_DEBUG("Client {} Closed", this->cli_text);
+                    this->stop();
+                }
+            }));
 }
 
 SocksV5::Method Socks5Session::choose_method() {
@@ -143,44 +323,45 @@ void Socks5Session::reply_support_method() {
     std::array<asio::const_buffer, 2> buf = {
         {asio::buffer(&this->ver, 1), asio::buffer(&this->method, 1)}};
 
-    auto self = shared_from_this();
+    session_ptr self(this);
     asio::async_write(
         this->socket, buf,
-        [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
-            if (!ec) {
-                SPDLOG_DEBUG(
-                    "Proxy {} -> Client {} DATA : [VER = "
-                    "X'{:02x}', "
-                    "METHOD = X'{:02x}']",
-                    convert::format_address(this->local_endpoint),
-                    convert::format_address(this->tcp_cli_endpoint),
-                    static_cast<int16_t>(this->ver),
-                    static_cast<int16_t>(this->method));
-
-                switch (this->method) {
-                    case SocksV5::Method::NoAuth: {
-                        this->do_no_auth();
-                    } break;
-
-                    case SocksV5::Method::UserPassWd: {
-                        this->do_username_password_auth();
-                    } break;
-
-                    case SocksV5::Method::GSSAPI: {
-                        // not supported
-                    } break;
+        make_custom_alloc_handler(
+            this->client_handler_memory,
+            [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
+                if (!ec) {
+                    SESSION_DEBUG(
+                        "Proxy {} -> Client {} DATA : [VER = "
+                        "X'{:02x}', "
+                        "METHOD = X'{:02x}']",
+                        this->local_text, this->cli_text,
+                        static_cast<int16_t>(this->ver),
+                        static_cast<int16_t>(this->method));
+
+                    switch (this->method) {
+                        case SocksV5::Method::NoAuth: {
+                            this->do_no_auth();
+                        } break;
+
+                        case SocksV5::Method::UserPassWd: {
+                            this->do_username_password_auth();
+                        } break;
+
+                        case SocksV5::Method::GSSAPI: {
+                            // not supported
+                        } break;
+
+                        case SocksV5::Method::NoAcceptable: {
+                            this->stats.add(metric::failed_method);
+                            this->stop();
+                        } break;
+                    }
 
-                    case SocksV5::Method::NoAcceptable: {
-                        this->stop();
-                    } break;
+                } else {
+                    SESSION_DEBUG("Client {} Closed", this->cli_text);
+                    this->stop();
                 }
-
-            } else {
-                SPDLOG_DEBUG("Client {} Closed",
-                             convert::format_address(this->tcp_cli_endpoint));
-                this->stop();
-            }
-        });
+            }));
 }
 
 void Socks5Session::do_no_auth() { this->get_request_from_client(); }
@@ -191,131 +372,135 @@ void Socks5Session::get_username_length() {
     std::array<asio::mutable_buffer, 2> buf = {
         {asio::buffer(&this->ver, 1), asio::buffer(&this->ulen, 1)}};
 
-    auto self = shared_from_this();
+    session_ptr self(this);
     asio::async_read(
         this->socket, buf,
-        [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
-            if (!ec) {
-                SPDLOG_DEBUG(
-                    "Client {} -> Proxy {} DATA : [VER = "
-                    "X'{:02x}', ULEN = {}]",
-                    convert::format_address(this->tcp_cli_endpoint),
-                    convert::format_address(this->local_endpoint),
-                    static_cast<int16_t>(this->ver),
-                    static_cast<int16_t>(this->ulen));
-
-                this->uname.resize(static_cast<std::size_t>(this->ulen));
-                this->get_username_content();
-            } else {
-                SPDLOG_DEBUG("Client {} Closed",
-                             convert::format_address(this->tcp_cli_endpoint));
-                this->stop();
-            }
-        });
+        make_custom_alloc_handler(
+            this->client_handler_memory,
+            [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
+                if (!ec) {
+                    SESSION_DEBUG(
+                        "Client {} -> Proxy {} DATA : [VER = "
+                        "X'{:02x}', ULEN = {}]",
+                        this->cli_text, this->local_text,
+                        static_cast<int16_t>(this->ver),
+                        static_cast<int16_t>(this->ulen));
+
+                    this->uname.resize(static_cast<std::size_t>(this->ulen));
+                    this->get_username_content();
+                } else {
+                    SESSION_DEBUG("Client {} Closed", this->cli_text);
+                    this->stop();
+                }
+            }));
 }
 
 void Socks5Session::get_username_content() {
-    auto self = shared_from_this();
+    session_ptr self(this);
     asio::async_read(
         this->socket, asio::buffer(this->uname.data(), this->uname.size()),
-        [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
-            if (!ec) {
-                SPDLOG_DEBUG(
-                    "Client {} -> Proxy {} DATA : [UNAME = {}]",
-                    convert::format_address(this->tcp_cli_endpoint),
-                    convert::format_address(this->local_endpoint),
-                    std::string(this->uname.begin(), this->uname.end()));
-
-                this->get_password_length();
-            } else {
-                SPDLOG_DEBUG("Client {} Closed",
-                             convert::format_address(this->tcp_cli_endpoint));
-                this->stop();
-            }
-        });
+        make_custom_alloc_handler(
+            this->client_handler_memory,
+            [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
+                if (!ec) {
+                    this->log_traced = Logger::getInstance()->InDebugScope(
+                        this->tcp_cli_endpoint.address(), this->uname.data(),
+                        this->uname.size());
+                    SESSION_DEBUG(
+                        "Client {} -> Proxy {} DATA : [UNAME = {}]",
+                        this->cli_text, this->local_text,
+                        std::string(this->uname.begin(), this->uname.end()));
+
+                    this->get_password_length();
+                } else {
+                    SESSION_DEBUG("Client {} Closed", this->cli_text);
+                    this->stop();
+                }
+            }));
 }
 
 void Socks5Session::get_password_length() {
     std::array<asio::mutable_buffer, 1> buf = {{asio::buffer(&plen, 1)}};
 
-    auto self = shared_from_this();
+    session_ptr self(this);
     asio::async_read(
         this->socket, buf,
-        [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
-            if (!ec) {
-                SPDLOG_DEBUG("Client {} -> Proxy {} DATA : [PLEN = {}]",
-                             convert::format_address(this->tcp_cli_endpoint),
-                             convert::format_address(this->local_endpoint),
-                             static_cast<int16_t>(this->plen));
-
-                this->passwd.resize(static_cast<std::size_t>(this->plen));
-                this->get_password_content();
-            } else {
-                SPDLOG_DEBUG("Client {} Closed",
-                             convert::format_address(this->tcp_cli_endpoint));
-                this->stop();
-            }
-        });
+        make_custom_alloc_handler(
+            this->client_handler_memory,
+            [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
+                if (!ec) {
+                    SESSION_DEBUG("Client {} -> Proxy {} DATA : [PLEN = {}]",
+                                  this->cli_text, this->local_text,
+                                  static_cast<int16_t>(this->plen));
+
+                    this->passwd.resize(static_cast<std::size_t>(this->plen));
+                    this->get_password_content();
+                } else {
+                    SESSION_DEBUG("Client {} Closed", this->cli_text);
+                    this->stop();
+                }
+            }));
 }
 
 void Socks5Session::get_password_content() {
-    auto self = shared_from_this();
+    session_ptr self(this);
     asio::async_read(
         this->socket, asio::buffer(this->passwd.data(), this->passwd.size()),
-        [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
-            if (!ec) {
-                SPDLOG_DEBUG(
-                    "Client {} -> Proxy {} DATA : [PASSWD = {}]",
-                    convert::format_address(this->tcp_cli_endpoint),
-                    convert::format_address(this->local_endpoint),
-                    std::string(this->passwd.begin(), this->passwd.end()));
-
-                this->do_auth_and_reply();
-            } else {
-                SPDLOG_DEBUG("Client {} Closed",
-                             convert::format_address(this->tcp_cli_endpoint));
-                this->stop();
-            }
-        });
+        make_custom_alloc_handler(
+            this->client_handler_memory,
+            [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
+                if (!ec) {
+                    // the password itself never goes to the log
+                    SESSION_DEBUG("Client {} -> Proxy {} DATA : [PLEN = {}]",
+                                  this->cli_text, this->local_text,
+                                  this->passwd.size());
+
+                    this->do_auth_and_reply();
+                } else {
+                    SESSION_DEBUG("Client {} Closed", this->cli_text);
+                    this->stop();
+                }
+            }));
 }
 
 void Socks5Session::do_auth_and_reply() {
-    if (ServerParser::global_config()->check_username(
-            std::string(this->uname.begin(), this->uname.end())) &&
-        ServerParser::global_config()->check_password(
-            std::string(this->passwd.begin(), this->passwd.end()))) {
+    if (asio::use_service<auth_cache>(this->ioc).check(
+            *ServerParser::global_config(), this->uname.data(),
+            this->uname.size(), this->passwd.data(), this->passwd.size())) {
         this->status = SocksV5::ReplyAuthStatus::Success;
     } else {
         this->status = SocksV5::ReplyAuthStatus::Failure;
+        this->stats.add(metric::failed_auth);
     }
+    this->record_phase(latency::auth);
 
     std::array<asio::const_buffer, 2> buf = {
         {asio::buffer(&this->ver, 1), asio::buffer(&this->status, 1)}};
 
-    auto self = shared_from_this();
+    session_ptr self(this);
     asio::async_write(
         this->socket, buf,
-        [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
-            if (!ec) {
-                SPDLOG_DEBUG(
-                    "Proxy {} -> Client {} DATA : [VER = "
-                    "X'{:02x}', STATUS = X'{:02x}']",
-                    convert::format_address(this->local_endpoint),
-                    convert::format_address(this->tcp_cli_endpoint),
-                    static_cast<int16_t>(this->ver),
-                    static_cast<int16_t>(this->status));
-
-                if (this->status == SocksV5::ReplyAuthStatus::Success) {
-                    this->get_request_from_client();
+        make_custom_alloc_handler(
+            this->client_handler_memory,
+            [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
+                if (!ec) {
+                    SESSION_DEBUG(
+                        "Proxy {} -> Client {} DATA : [VER = "
+                        "X'{:02x}', STATUS = X'{:02x}']",
+                        this->local_text, this->cli_text,
+                        static_cast<int16_t>(this->ver),
+                        static_cast<int16_t>(this->status));
+
+                    if (this->status == SocksV5::ReplyAuthStatus::Success) {
+                        this->get_request_from_client();
+                    } else {
+                        this->stop();
+                    }
                 } else {
+                    SESSION_DEBUG("Client {} Closed", this->cli_text);
                     this->stop();
                 }
-            } else {
-                SPDLOG_DEBUG("Client {} Closed",
-                             convert::format_address(this->tcp_cli_endpoint));
-                this->stop();
-            }
-        });
+            }));
 }
 
 void Socks5Session::get_request_from_client() {
@@ -323,28 +508,28 @@ void Socks5Session::get_request_from_client() {
         {asio::buffer(&this->ver, 1), asio::buffer(&this->cmd, 1),
          asio::buffer(&this->rsv, 1), asio::buffer(&this->request_atyp, 1)}};
 
-    auto self = shared_from_this();
+    session_ptr self(this);
     asio::async_read(
         this->socket, buf,
-        [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
-            if (!ec) {
-                SPDLOG_DEBUG(
-                    "Client {} -> Proxy {} DATA : [VER = X'{:02x}', CMD "
-                    "= X'{:02x}, RSV = X'{:02x}', ATYP = X'{:02x}']",
-                    convert::format_address(this->tcp_cli_endpoint),
-                    convert::format_address(this->local_endpoint),
-                    static_cast<int16_t>(this->ver),
-                    static_cast<int16_t>(this->cmd),
-                    static_cast<int16_t>(this->rsv),
-                    static_cast<int16_t>(this->request_atyp));
-
-                this->get_dst_information();
-            } else {
-                SPDLOG_DEBUG("Client {} Closed",
-                             convert::format_address(this->tcp_cli_endpoint));
-                this->stop();
-            }
-        });
+        make_custom_alloc_handler(
+            this->client_handler_memory,
+            [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
+                if (!ec) {
+                    SESSION_DEBUG(
+                        "Client {} -> Proxy {} DATA : [VER = X'{:02x}', CMD "
+                        "= X'{:02x}, RSV = X'{:02x}', ATYP = X'{:02x}']",
+                        this->cli_text, this->local_text,
+                        static_cast<int16_t>(this->ver),
+                        static_cast<int16_t>(this->cmd),
+                        static_cast<int16_t>(this->rsv),
+                        static_cast<int16_t>(this->request_atyp));
+
+                    this->get_dst_information();
+                } else {
+                    SESSION_DEBUG("Client {} Closed", this->cli_text);
+                    this->stop();
+                }
+            }));
 }
 
 void Socks5Session::get_dst_information() {
@@ -376,29 +561,29 @@ void Socks5Session::resolve_ipv4() {
         {asio::buffer(this->dst_addr.data(), this->dst_addr.size()),
          asio::buffer(&this->dst_port, 2)}};
 
-    auto self = shared_from_this();
+    session_ptr self(this);
     asio::async_read(
         this->socket, buf,
-        [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
-            if (!ec) {
-                // network octet order convert to host octet order
-                this->dst_port = ntohs(this->dst_port);
-
-                SPDLOG_DEBUG(
-                    "Client {} -> Proxy {} DATA : [DST.ADDR = "
-                    "{}, DST.PORT = {}]",
-                    convert::format_address(this->tcp_cli_endpoint),
-                    convert::format_address(this->local_endpoint),
-                    convert::dst_to_string(this->dst_addr, ATyp::Ipv4),
-                    this->dst_port);
-
-                this->execute_command();
-            } else {
-                SPDLOG_DEBUG("Client {} Closed",
-                             convert::format_address(this->tcp_cli_endpoint));
-                this->stop();
-            }
-        });
+        make_custom_alloc_handler(
+            this->client_handler_memory,
+            [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
+                if (!ec) {
+                    // network octet order convert to host octet order
+                    this->dst_port = ntohs(this->dst_port);
+
+                    SESSION_DEBUG(
+                        "Client {} -> Proxy {} DATA : [DST.ADDR = "
+                        "{}, DST.PORT = {}]",
+                        this->cli_text, this->local_text,
+                        convert::dst_to_string(this->dst_addr, ATyp::Ipv4),
+                        this->dst_port);
+
+                    this->execute_command();
+                } else {
+                    SESSION_DEBUG("Client {} Closed", this->cli_text);
+                    this->stop();
+                }
+            }));
 }
 
 void Socks5Session::resolve_ipv6() {
@@ -406,29 +591,29 @@ void Socks5Session::resolve_ipv6() {
         {asio::buffer(this->dst_addr.data(), this->dst_addr.size()),
          asio::buffer(&this->dst_port, 2)}};
 
-    auto self = shared_from_this();
+    session_ptr self(this);
     asio::async_read(
         this->socket, buf,
-        [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
-            if (!ec) {
-                // network octet order convert to host octet order
-                this->dst_port = ntohs(this->dst_port);
-
-                SPDLOG_DEBUG(
-                    "Client {} -> Proxy {} DATA : [DST.ADDR "
-                    "= {}, DST.PORT = {}]",
-                    convert::format_address(this->tcp_cli_endpoint),
-                    convert::format_address(this->local_endpoint),
-                    convert::dst_to_string(this->dst_addr, ATyp::Ipv6),
-                    this->dst_port);
-
-                this->execute_command();
-            } else {
-                SPDLOG_DEBUG("Client {} Closed",
-                             convert::format_address(this->tcp_cli_endpoint));
-                this->stop();
-            }
-        });
+        make_custom_alloc_handler(
+            this->client_handler_memory,
+            [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
+                if (!ec) {
+                    // network octet order convert to host octet order
+                    this->dst_port = ntohs(this->dst_port);
+
+                    SESSION_DEBUG(
+                        "Client {} -> Proxy {} DATA : [DST.ADDR "
+                        "= {}, DST.PORT = {}]",
+                        this->cli_text, this->local_text,
+                        convert::dst_to_string(this->dst_addr, ATyp::Ipv6),
+                        this->dst_port);
+
+                    this->execute_command();
+                } else {
+                    SESSION_DEBUG("Client {} Closed", this->cli_text);
+                    this->stop();
+                }
+            }));
 }
 
 void Socks5Session::resolve_domain() { this->resolve_domain_length(); }
@@ -437,27 +622,27 @@ void Socks5Session::resolve_domain_length() {
     std::array<asio::mutable_buffer, 1> buf = {
         asio::buffer(this->dst_addr.data(), 1)};
 
-    auto self = shared_from_this();
+    session_ptr self(this);
     asio::async_read(
         this->socket, buf,
-        [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
-            if (!ec) {
-                SPDLOG_DEBUG(
-                    "Client {} -> Proxy {} DATA : "
-                    "[DOMAIN_LENGTH = {}]",
-                    convert::format_address(this->tcp_cli_endpoint),
-                    convert::format_address(this->local_endpoint),
-                    static_cast<int16_t>(this->dst_addr[0]));
-
-                this->dst_addr.resize(
-                    static_cast<std::size_t>(this->dst_addr[0]));
-                this->resolve_domain_content();
-            } else {
-                SPDLOG_DEBUG("Client {} Closed",
-                             convert::format_address(this->tcp_cli_endpoint));
-                this->stop();
-            }
-        });
+        make_custom_alloc_handler(
+            this->client_handler_memory,
+            [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
+                if (!ec) {
+                    SESSION_DEBUG(
+                        "Client {} -> Proxy {} DATA : "
+                        "[DOMAIN_LENGTH = {}]",
+                        this->cli_text, this->local_text,
+                        static_cast<int16_t>(this->dst_addr[0]));
+
+                    this->dst_addr.resize(
+                        static_cast<std::size_t>(this->dst_addr[0]));
+                    this->resolve_domain_content();
+                } else {
+                    SESSION_DEBUG("Client {} Closed", this->cli_text);
+                    this->stop();
+                }
+            }));
 }
 
 void Socks5Session::resolve_domain_content() {
@@ -465,32 +650,35 @@ void Socks5Session::resolve_domain_content() {
         {asio::buffer(this->dst_addr.data(), this->dst_addr.size()),
          asio::buffer(&this->dst_port, 2)}};
 
-    auto self = shared_from_this();
+    session_ptr self(this);
     asio::async_read(
         this->socket, buf,
-        [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
-            if (!ec) {
-                // network octet order convert to host octet order
-                this->dst_port = ntohs(this->dst_port);
-
-                SPDLOG_DEBUG(
-                    "Client {} -> Proxy {} DATA : [DST.ADDR = "
-                    "{}, DST.PORT = {}]",
-                    convert::format_address(this->tcp_cli_endpoint),
-                    convert::format_address(this->local_endpoint),
-                    convert::dst_to_string(this->dst_addr, ATyp::DoMainName),
-                    this->dst_port);
-
-                this->execute_command();
-            } else {
-                SPDLOG_DEBUG("Client {} Closed",
-                             convert::format_address(this->tcp_cli_endpoint));
-                this->stop();
-            }
-        });
+        make_custom_alloc_handler(
+            this->client_handler_memory,
+            [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
+                if (!ec) {
+                    // network octet order convert to host octet order
+                    this->dst_port = ntohs(this->dst_port);
+
+                    SESSION_DEBUG(
+                        "Client {} -> Proxy {} DATA : [DST.ADDR = "
+                        "{}, DST.PORT = {}]",
+                        this->cli_text, this->local_text,
+                        convert::dst_to_string(this->dst_addr,
+                                               ATyp::DoMainName),
+                        this->dst_port);
+
+                    this->execute_command();
+                } else {
+                    SESSION_DEBUG("Client {} Closed", this->cli_text);
+                    this->stop();
+                }
+            }));
 }
 
 void Socks5Session::execute_command() {
+    this->record_phase(latency::request);
+    this->request_read = true;
     switch (this->cmd) {
         case SocksV5::RequestCMD::Connect: {
             this->set_connect_endpoint();
@@ -564,174 +752,310 @@ void Socks5Session::set_udp_associate_endpoint() {
 }
 
 void Socks5Session::async_udp_dns_reslove() {
-    auto self = shared_from_this();
+    this->stats.add(metric::dns_lookups);
+
+    session_ptr self(this);
     this->udp_resolver.async_resolve(
         convert::dst_to_string(this->dst_addr, ATyp::DoMainName),
         std::to_string(this->dst_port),
-        [this, self](asio::error_code ec,
-                     const asio::ip::udp::resolver::results_type& result) {
-            if (!ec) {
-                this->resolve_results = result;
-
-                // use first endpoint
-                this->udp_cli_endpoint =
-                    this->resolve_results.begin()->endpoint();
-
-                SPDLOG_DEBUG(
-                    "Reslove Domain {} {} result sets in total",
-                    convert::dst_to_string(this->dst_addr, ATyp::DoMainName),
-                    this->resolve_results.size());
-
-                this->reply_udp_associate();
-            } else {
-                SPDLOG_WARN(
-                    "Failed to Reslove Domain {}, ERR_MSG = [{}]",
-                    convert::dst_to_string(this->dst_addr, ATyp::DoMainName),
-                    ec.message());
-
-                this->reply_and_stop(SocksV5::ReplyREP::HostUnreachable);
-            }
-        });
+        make_custom_alloc_handler(
+            this->resolve_handler_memory,
+            [this, self](asio::error_code ec,
+                         const asio::ip::udp::resolver::results_type& result) {
+                if (!ec) {
+                    this->resolve_results = result;
+
+                    // use first endpoint
+                    this->udp_cli_endpoint =
+                        this->resolve_results.begin()->endpoint();
+
+                    SESSION_DEBUG(
+                        "Reslove Domain {} {} result sets in total",
+                        convert::dst_to_string(this->dst_addr,
+                                               ATyp::DoMainName),
+                        this->resolve_results.size());
+
+                    this->reply_udp_associate();
+                } else {
+                    this->stats.add(metric::dns_failures);
+                    SPDLOG_WARN(
+                        "Failed to Reslove Domain {}, ERR_MSG = [{}]",
+                        convert::dst_to_string(this->dst_addr,
+                                               ATyp::DoMainName),
+                        ec.message());
+
+                    this->reply_and_stop(SocksV5::ReplyREP::HostUnreachable);
+                }
+            }));
 }
 
 void Socks5Session::reply_udp_associate() {
     this->rep = SocksV5::ReplyREP::Succeeded;
+    this->replied = true;
     try {
-        if (this->udp_cli_endpoint.address().is_v4()) {
-            this->reply_atyp = SocksV5::ReplyATYP::Ipv4;
-            this->udp_socket.reset(new asio::ip::udp::socket(
-                this->ioc, asio::ip::udp::endpoint(asio::ip::udp::v4(), 0)));
-            this->bnd_addr.resize(4);
-            std::memcpy(this->bnd_addr.data(),
-                        this->udp_socket->local_endpoint()
-                            .address()
-                            .to_v4()
-                            .to_bytes()
-                            .data(),
-                        4);
-        } else {
-            this->reply_atyp = SocksV5::ReplyATYP::Ipv6;
-            this->udp_socket.reset(new asio::ip::udp::socket(
-                this->ioc, asio::ip::udp::endpoint(asio::ip::udp::v6(), 0)));
-            this->bnd_addr.resize(16);
-            std::memcpy(this->bnd_addr.data(),
-                        this->udp_socket->local_endpoint()
-                            .address()
-                            .to_v6()
-                            .to_bytes()
-                            .data(),
-                        16);
-        }
-
-        this->udp_bnd_endpoint = this->udp_socket->local_endpoint();
-
-        // host octet order convert to network octet order
-        this->bnd_port = htons(this->udp_bnd_endpoint.port());
-
+        this->open_udp_relay();
     } catch (const asio::system_error& e) {
         SPDLOG_WARN("Failed to reply udp associate, ERR_MSG = [{}]",
                     std::string(e.what()));
+        this->reply_and_stop(SocksV5::ReplyREP::GenServFailed);
+        return;
     }
 
+    this->udp_bnd_endpoint = this->udp_relay->get_local_endpoint();
+
+    this->set_reply_address(this->udp_bnd_endpoint);
+
     std::array<asio::mutable_buffer, 6> buf = {
         {asio::buffer(&this->ver, 1), asio::buffer(&this->rep, 1),
          asio::buffer(&this->rsv, 1), asio::buffer(&this->reply_atyp, 1),
          asio::buffer(this->bnd_addr.data(), this->bnd_addr.size()),
          asio::buffer(&this->bnd_port, 2)}};
 
-    auto self = shared_from_this();
+    session_ptr self(this);
     asio::async_write(
         this->socket, buf,
-        [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
-            if (!ec) {
-                SPDLOG_DEBUG(
-                    "Proxy {} -> Client {} DATA : [VER = "
-                    "X'{:02x}', REP = X'{:02x}', RSV = X'{:02x}' "
-                    "ATYP = X'{:02x}', BND.ADDR = {}, BND.PORT = {}]",
-                    convert::format_address(this->local_endpoint),
-                    convert::format_address(this->tcp_cli_endpoint),
-                    static_cast<int16_t>(this->ver),
-                    static_cast<int16_t>(this->rep),
-                    static_cast<int16_t>(this->rsv),
-                    static_cast<int16_t>(this->reply_atyp),
-                    this->udp_bnd_endpoint.address().to_string(),
-                    this->udp_bnd_endpoint.port());
+        make_custom_alloc_handler(
+            this->client_handler_memory,
+            [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
+                if (!ec) {
+                    SESSION_DEBUG(
+                        "Proxy {} -> Client {} DATA : [VER = "
+                        "X'{:02x}', REP = X'{:02x}', RSV = X'{:02x}' "
+                        "ATYP = X'{:02x}', BND.ADDR = {}, BND.PORT = {}]",
+                        this->local_text, this->cli_text,
+                        static_cast<int16_t>(this->ver),
+                        static_cast<int16_t>(this->rep),
+                        static_cast<int16_t>(this->rsv),
+                        static_cast<int16_t>(this->reply_atyp),
+                        this->udp_bnd_endpoint.address().to_string(),
+                        this->udp_bnd_endpoint.port());
+
+                    this->client_buffer.resize(BUFSIZ);
+
+                    this->wait_udp_control();
+                    this->receive_udp_message();
+                } else {
+                    SESSION_DEBUG("Client {} Closed", this->cli_text);
+                    this->stop();
+                }
+            }));
+}
+
+void Socks5Session::open_udp_relay() {
+    if (ServerParser::global_config()->get_udp_relay_sockets() > 0) {
+        this->udp_relay = asio::use_service<UdpRelayPool>(this->ioc).acquire(
+            this->udp_cli_endpoint.protocol());
+    } else {
+        this->udp_relay = udp_relay_ptr(new UdpRelaySocket(
+            this->ioc, this->udp_cli_endpoint.protocol(), false));
+        this->udp_relay->start();
+    }
 
-                this->client_buffer.resize(BUFSIZ);
+    this->register_udp_client();
+}
 
-                this->get_udp_client();
-            } else {
-                SPDLOG_DEBUG("Client {} Closed",
-                             convert::format_address(this->tcp_cli_endpoint));
-                this->stop();
+void Socks5Session::register_udp_client() {
+    if (this->request_atyp == SocksV5::RequestATYP::DoMainName) {
+        for (auto&& entry : this->resolve_results) {
+            this->bind_udp_client(entry.endpoint());
+        }
+        return;
+    }
+
+    if (this->check_all_zeros() || this->check_dst_addr_all_zeros()) {
+        // the first sender becomes the client, on a shared relay socket it
+        // must at least come from the host of the TCP connection
+        if (this->udp_relay->is_shared()) {
+            // a dual stack listener reports IPv4 clients as v4-mapped
+            asio::ip::address address = this->tcp_cli_endpoint.address();
+            if (address.is_v6() && address.to_v6().is_v4_mapped()) {
+                address = asio::ip::make_address_v4(asio::ip::v4_mapped,
+                                                     address.to_v6());
             }
-        });
+            this->udp_relay->bind_client_address(address, this);
+            this->udp_client_addresses.push_back(address);
+        } else {
+            this->udp_relay->bind_any_client(this);
+        }
+        return;
+    }
+
+    this->bind_udp_client(this->udp_cli_endpoint);
 }
 
-void Socks5Session::get_udp_client() {
-    auto self = shared_from_this();
-    this->udp_socket->async_receive_from(
-        asio::buffer(this->client_buffer.data(), this->client_buffer.size()),
-        this->sender_endpoint,
-        [this, self](asio::error_code ec, size_t length) {
-            if (!ec) {
-                this->udp_length = length;
+void Socks5Session::bind_udp_client(const asio::ip::udp::endpoint& endpoint) {
+    if (endpoint.port() == 0) {
+        this->udp_relay->bind_client_address(endpoint.address(), this);
+        this->udp_client_addresses.push_back(endpoint.address());
+    } else {
+        this->udp_relay->bind_client(endpoint, this);
+        this->udp_client_endpoints.push_back(endpoint);
+    }
+}
+
+bool Socks5Session::bind_udp_server_relay() {
+    if (this->udp_server_relay &&
+        this->udp_server_endpoint == this->udp_dst_endpoint) {
+        return true;
+    }
+
+    this->release_udp_server_relay();
+
+    if (this->udp_relay->is_shared()) {
+        this->udp_server_relay =
+            asio::use_service<UdpRelayPool>(this->ioc).bind_server(
+                this->udp_dst_endpoint, this, this->udp_relay);
+        this->udp_server_endpoint = this->udp_dst_endpoint;
+        return static_cast<bool>(this->udp_server_relay);
+    }
 
-                SPDLOG_DEBUG("UDP Client {} -> Proxy {} Data Length = {}",
-                             convert::format_address(this->sender_endpoint),
-                             convert::format_address(this->udp_bnd_endpoint),
-                             this->udp_length);
+    // a private relay serves any server, unless it has the other protocol
+    auto protocol = this->udp_dst_endpoint.protocol();
+    if (this->udp_relay->get_local_endpoint().protocol() == protocol) {
+        this->udp_relay->bind_server(this->udp_dst_endpoint, this);
+        this->udp_server_relay = this->udp_relay;
+        this->udp_server_endpoint = this->udp_dst_endpoint;
+        return true;
+    }
+
+    try {
+        udp_relay_ptr relay(new UdpRelaySocket(this->ioc, protocol, false));
+        relay->start();
+        relay->bind_server(this->udp_dst_endpoint, this);
+        this->udp_server_relay = relay;
+        this->udp_server_endpoint = this->udp_dst_endpoint;
+        return true;
+    } catch (const asio::system_error& e) {
+        SPDLOG_WARN("Failed to open UDP relay socket, ERR_MSG = [{}]",
+                    std::string(e.what()));
+    }
+    return false;
+}
+
+void Socks5Session::release_udp_server_relay() {
+    if (!this->udp_server_relay) {
+        return;
+    }
+
+    if (this->udp_server_relay->is_shared()) {
+        asio::use_service<UdpRelayPool>(this->ioc).unbind_server(
+            this->udp_server_relay, this->udp_server_endpoint, this);
+    } else {
+        this->udp_server_relay->unbind_server(this->udp_server_endpoint, this);
+        if (this->udp_server_relay != this->udp_relay) {
+            this->udp_server_relay->close();
+        }
+    }
+    this->udp_server_relay.reset();
+}
+
+void Socks5Session::release_udp_relay() {
+    this->release_udp_server_relay();
+
+    if (!this->udp_relay) {
+        return;
+    }
+
+    if (this->udp_relay->is_shared()) {
+        for (auto&& endpoint : this->udp_client_endpoints) {
+            this->udp_relay->unbind_client(endpoint, this);
+        }
+        for (auto&& address : this->udp_client_addresses) {
+            this->udp_relay->unbind_client_address(address, this);
+        }
+    } else {
+        this->udp_relay->close();
+    }
+
+    this->udp_client_endpoints.clear();
+    this->udp_client_addresses.clear();
+    this->udp_relay.reset();
+}
 
-                if (this->check_sender_endpoint()) {
-                    this->parse_udp_message();
+void Socks5Session::wait_udp_control() {
+    // the TCP connection carries no more data, anything read is discarded
+    this->dst_buffer.resize(64);
+
+    session_ptr self(this);
+    this->socket.async_read_some(
+        asio::buffer(this->dst_buffer.data(), this->dst_buffer.size()),
+        make_custom_alloc_handler(
+            this->client_handler_memory,
+            [this, self](asio::error_code ec, size_t /*length*/) {
+                if (!ec) {
+                    this->wait_udp_control();
                 } else {
-                    this->get_udp_client();
+                    SESSION_DEBUG("Client {} Closed", this->cli_text);
+                    this->stop();
                 }
-            } else {
-                SPDLOG_DEBUG("Failed to receive UDP message from client");
-                this->stop();
-            }
-        });
+            }));
 }
 
-bool Socks5Session::check_sender_endpoint() {
-    if (this->check_all_zeros()) {
-        this->udp_cli_endpoint = this->sender_endpoint;
-        return true;
+bool Socks5Session::on_udp_client_message(UdpRelaySocket& relay,
+                                          const asio::ip::udp::endpoint& sender,
+                                          const uint8_t* data, size_t length) {
+    // first datagram of a client bound by address only
+    if (std::find(this->udp_client_endpoints.begin(),
+                  this->udp_client_endpoints.end(),
+                  sender) == this->udp_client_endpoints.end()) {
+        relay.unbind_client_address(sender.address(), this);
+        relay.bind_any_client(nullptr);
+        relay.bind_client(sender, this);
+        this->udp_client_endpoints.push_back(sender);
     }
 
-    switch (this->request_atyp) {
-        case SocksV5::RequestATYP::Ipv4: {
-            if (this->check_dst_addr_all_zeros()) {
-                // this->udp_cli_endpoint =
-                //     asio::ip::udp::endpoint(asio::ip::address_v4::loopback(),
-                //                             this->udp_cli_endpoint.port());
-                this->udp_cli_endpoint = this->sender_endpoint;
-                return true;
-            }
-        } break;
+    if (this->udp_busy || this->udp_resolving) {
+        return this->udp_client_queue.push(sender, data, length);
+    }
 
-        case SocksV5::RequestATYP::Ipv6: {
-            if (this->check_dst_addr_all_zeros()) {
-                // this->udp_cli_endpoint =
-                //     asio::ip::udp::endpoint(asio::ip::address_v6::loopback(),
-                //                             this->udp_cli_endpoint.port());
-                this->udp_cli_endpoint = this->sender_endpoint;
-                return true;
-            }
-        } break;
+    this->udp_busy = true;
+    this->udp_length = length;
+    if (this->udp_length > this->client_buffer.size()) {
+        this->client_buffer.resize(this->udp_length);
+    }
+    std::memcpy(this->client_buffer.data(), data, length);
+    this->relay_udp_client_message(sender);
+    return true;
+}
 
-        case SocksV5::RequestATYP::DoMainName: {
-            for (auto iter : this->resolve_results) {
-                if (iter.endpoint() == this->sender_endpoint) {
-                    return true;
-                }
-            }
-            return false;
-        } break;
-    };
+bool Socks5Session::on_udp_server_message(const asio::ip::udp::endpoint& sender,
+                                          const uint8_t* data, size_t length) {
+    if (this->udp_busy) {
+        return this->udp_server_queue.push(sender, data, length);
+    }
+
+    this->udp_busy = true;
+    this->udp_length = length;
+    if (this->udp_length > this->client_buffer.size()) {
+        this->client_buffer.resize(this->udp_length);
+    }
+    std::memcpy(this->client_buffer.data(), data, length);
+    this->relay_udp_server_message(sender);
+    return true;
+}
+
+void Socks5Session::relay_udp_client_message(
+    const asio::ip::udp::endpoint& sender) {
+    this->udp_cli_endpoint = sender;
+    this->stats.add(metric::udp_client_datagrams);
+
+    SESSION_TRACE("UDP Client {} -> Proxy {} Data Length = {}",
+                  this->udp_cli_endpoint, this->udp_bnd_endpoint,
+                  this->udp_length);
+
+    this->keep_alive();
+    this->parse_udp_message();
+}
+
+void Socks5Session::relay_udp_server_message(
+    const asio::ip::udp::endpoint& sender) {
+    this->stats.add(metric::udp_upstream_datagrams);
 
-    return this->udp_cli_endpoint == this->sender_endpoint;
+    SESSION_TRACE("UDP Server {} -> Proxy {} Data Length = {}", sender,
+                  this->udp_bnd_endpoint, this->udp_length);
+
+    this->keep_alive();
+    this->send_udp_to_client();
 }
 
 bool Socks5Session::check_all_zeros() {
@@ -765,12 +1089,18 @@ void Socks5Session::parse_udp_message() {
         return;
     }
 
-    std::memcpy(&this->frag, this->client_buffer.data() + 2,
-                sizeof(this->frag));
-    if (this->frag != 0) {
-        SPDLOG_WARN("Udp Associate Not Support Splice Process");
-        this->stop();
-        return;
+    uint8_t frag = this->client_buffer[2];
+    if (frag != 0) {
+        if (this->udp_header_length() == 0) {
+            SPDLOG_WARN("Udp Associate Fragment Length Error");
+            this->stop();
+            return;
+        }
+
+        if (!this->reassemble_udp_fragment(frag)) {
+            this->receive_udp_message();
+            return;
+        }
     }
 
     std::memcpy(&this->reply_atyp, this->client_buffer.data() + 3,
@@ -859,31 +1189,199 @@ void Socks5Session::parse_udp_message() {
     }
 }
 
+size_t Socks5Session::udp_header_length() {
+    size_t header_length = 0;
+    switch (static_cast<SocksV5::ReplyATYP>(this->client_buffer[3])) {
+        case SocksV5::ReplyATYP::Ipv4: {
+            header_length = 1 + 4 + 2;
+        } break;
+
+        case SocksV5::ReplyATYP::Ipv6: {
+            header_length = 1 + 16 + 2;
+        } break;
+
+        case SocksV5::ReplyATYP::DoMainName: {
+            if (this->udp_length <= 5) {
+                return 0;
+            }
+            header_length = 1 + 1 + this->client_buffer[4] + 2;
+        } break;
+
+        default: {
+            return 0;
+        }
+    }
+
+    // at least one byte of user data must follow the header
+    if (this->udp_length <= 3 + header_length) {
+        return 0;
+    }
+    return header_length;
+}
+
+bool Socks5Session::reassemble_udp_fragment(uint8_t frag) {
+    uint8_t position = frag & 0x7f;
+    bool end_of_sequence = (frag & 0x80) != 0;
+
+    if (position <= this->frag_position) {
+        SESSION_DEBUG("Udp Associate Fragment Sequence Restarted");
+        this->reset_udp_reassembly();
+    }
+
+    if (position != this->frag_position + 1) {
+        SPDLOG_WARN("Udp Associate Fragment {} Out Of Order, Expected {}",
+                    static_cast<int16_t>(position),
+                    static_cast<int16_t>(this->frag_position + 1));
+        this->reset_udp_reassembly();
+        return false;
+    }
+
+    size_t header_length = this->udp_header_length();
+    const uint8_t* header = this->client_buffer.data() + 3;
+    const uint8_t* data = header + header_length;
+    size_t data_length = this->udp_length - 3 - header_length;
+
+    if (position == 1) {
+        this->frag_header.assign(header, header + header_length);
+        this->wait_reassembly_timeout();
+    } else if (this->frag_header.size() != header_length ||
+               std::memcmp(this->frag_header.data(), header, header_length) !=
+                   0) {
+        SPDLOG_WARN("Udp Associate Fragment Destination Mismatch");
+        this->reset_udp_reassembly();
+        return false;
+    }
+
+    if (3 + header_length + this->frag_buffer.size() + data_length >
+        udp_reassembly_max_size) {
+        SPDLOG_WARN("Udp Associate Reassembly Queue Overflow");
+        this->reset_udp_reassembly();
+        return false;
+    }
+
+    this->frag_buffer.insert(this->frag_buffer.end(), data, data + data_length);
+    this->frag_position = position;
+
+    if (!end_of_sequence) {
+        return false;
+    }
+
+    SESSION_DEBUG("Udp Associate Reassembled {} Fragments, Data Length = {}",
+                  static_cast<int16_t>(position), this->frag_buffer.size());
+
+    // rebuild a standalone datagram : RSV | FRAG = 0 | header | data
+    this->udp_length = 3 + this->frag_header.size() + this->frag_buffer.size();
+    if (this->udp_length > this->client_buffer.size()) {
+        this->client_buffer.resize(this->udp_length);
+    }
+
+    this->client_buffer[2] = 0;
+    std::memcpy(this->client_buffer.data() + 3, this->frag_header.data(),
+                this->frag_header.size());
+    std::memcpy(this->client_buffer.data() + 3 + this->frag_header.size(),
+                this->frag_buffer.data(), this->frag_buffer.size());
+
+    this->reset_udp_reassembly();
+    return true;
+}
+
+void Socks5Session::reset_udp_reassembly() {
+    asio::error_code ignored_ec;
+    this->frag_timer.cancel(ignored_ec);
+    this->frag_position = 0;
+    this->frag_header.clear();
+    this->frag_buffer.clear();
+}
+
+void Socks5Session::wait_reassembly_timeout() {
+    this->frag_timer.expires_after(
+        asio::chrono::seconds(udp_reassembly_timeout));
+
+    session_ptr self(this);
+    this->frag_timer.async_wait(make_custom_alloc_handler(
+        this->timer_handler_memory, [this, self](asio::error_code ec) {
+            // a new sequence may have re-armed the timer in the meantime
+            if (!ec && this->frag_timer.expiry() <=
+                           asio::steady_timer::clock_type::now()) {
+                SESSION_DEBUG(
+                    "Udp Associate Reassembly Timeout, {} Bytes Abandoned",
+                    this->frag_buffer.size());
+                this->frag_position = 0;
+                this->frag_header.clear();
+                this->frag_buffer.clear();
+            }
+        }));
+}
+
 void Socks5Session::async_send_udp_message() {
-    auto self = shared_from_this();
+    if (this->udp_resolved_name == this->dst_addr &&
+        this->udp_resolved_port == this->dst_port &&
+        asio::steady_timer::clock_type::now() <
+            this->udp_resolved_at +
+                asio::chrono::seconds(udp_resolve_cache_time)) {
+        this->try_to_send_by_iterator(this->resolve_results.begin());
+        return;
+    }
+
+    this->stats.add(metric::dns_lookups);
+
+    // the datagram waits aside, the association is free in the meantime
+    this->udp_resolving = true;
+    this->udp_resolve_buffer.swap(this->client_buffer);
+    this->udp_resolve_length = this->udp_length;
+
+    session_ptr self(this);
     this->udp_resolver.async_resolve(
         std::string(this->dst_addr.begin() + 1, this->dst_addr.end()),
         std::to_string(this->dst_port),
-        [this, self](asio::error_code ec,
-                     const asio::ip::udp::resolver::results_type& result) {
-            if (!ec) {
-                this->resolve_results = result;
+        make_custom_alloc_handler(
+            this->resolve_handler_memory,
+            [this, self](asio::error_code ec,
+                         const asio::ip::udp::resolver::results_type& result) {
+                if (ec == asio::error::operation_aborted) {
+                    return;
+                }
 
-                SPDLOG_DEBUG("Reslove Domain {} {} result sets in total",
-                             std::string(this->dst_addr.begin() + 1,
-                                         this->dst_addr.end()),
-                             this->resolve_results.size());
+                this->udp_resolving = false;
+                if (!ec) {
+                    this->udp_resolve_results = result;
+                    this->udp_resolved = true;
 
-                this->try_to_send_by_iterator(this->resolve_results.begin());
-            } else {
-                SPDLOG_WARN("Failed to Reslove Domain {}, ERR_MSG = [{}]",
-                            std::string(this->dst_addr.begin() + 1,
-                                        this->dst_addr.end()),
-                            ec.message());
+                    SESSION_DEBUG("Reslove Domain {} {} result sets in total",
+                                  std::string(this->dst_addr.begin() + 1,
+                                              this->dst_addr.end()),
+                                  result.size());
 
-                this->stop();
-            }
-        });
+                    if (!this->udp_busy) {
+                        this->receive_udp_message();
+                    }
+                } else {
+                    this->stats.add(metric::dns_failures);
+                    SPDLOG_WARN("Failed to Reslove Domain {}, ERR_MSG = [{}]",
+                                std::string(this->dst_addr.begin() + 1,
+                                            this->dst_addr.end()),
+                                ec.message());
+
+                    this->stop();
+                }
+            }));
+
+    this->receive_udp_message();
+}
+
+void Socks5Session::send_resolved_udp_message() {
+    this->udp_resolved = false;
+    this->udp_busy = true;
+
+    // no send walks the previous endpoints any more
+    this->resolve_results = this->udp_resolve_results;
+    this->udp_resolved_name = this->dst_addr;
+    this->udp_resolved_port = this->dst_port;
+    this->udp_resolved_at = asio::steady_timer::clock_type::now();
+
+    this->client_buffer.swap(this->udp_resolve_buffer);
+    this->udp_length = this->udp_resolve_length;
+    this->try_to_send_by_iterator(this->resolve_results.begin());
 }
 
 void Socks5Session::try_to_send_by_iterator(
@@ -895,59 +1393,70 @@ void Socks5Session::try_to_send_by_iterator(
 
     this->udp_dst_endpoint = iter->endpoint();
 
-    SPDLOG_DEBUG("Try to Send {}",
-                 convert::format_address(this->udp_dst_endpoint));
+    SESSION_DEBUG("Try to Send {}", this->udp_dst_endpoint);
 
     ++iter;
 
-    auto self = shared_from_this();
-    this->udp_socket->async_send_to(
+    if (!this->bind_udp_server_relay()) {
+        this->try_to_send_by_iterator(iter);
+        return;
+    }
+
+    session_ptr self(this);
+    this->udp_server_relay->get_socket().async_send_to(
         asio::buffer(this->client_buffer.data(), this->udp_length),
         this->udp_dst_endpoint,
-        [this, self, iter](asio::error_code ec, size_t length) {
-            if (!ec) {
-                SPDLOG_TRACE("Proxy {} -> UDP Server {} Data Length = {}",
-                             convert::format_address(this->udp_bnd_endpoint),
-                             convert::format_address(this->udp_dst_endpoint),
-                             length);
-
-                this->keep_alive();
-                this->receive_udp_message();
-            } else {
-                this->try_to_send_by_iterator(iter);
-            }
-        });
+        make_custom_alloc_handler(
+            this->dst_handler_memory,
+            [this, self, iter](asio::error_code ec, size_t length) {
+                if (!ec) {
+                    SESSION_TRACE("Proxy {} -> UDP Server {} Data Length = {}",
+                                  this->udp_bnd_endpoint,
+                                  this->udp_dst_endpoint, length);
+
+                    this->keep_alive();
+                    this->receive_udp_message();
+                } else {
+                    this->try_to_send_by_iterator(iter);
+                }
+            }));
 }
 
 void Socks5Session::send_udp_to_dst() {
-    auto self = shared_from_this();
-    udp_socket->async_send_to(
+    if (!this->bind_udp_server_relay()) {
+        this->stop();
+        return;
+    }
+
+    session_ptr self(this);
+    this->udp_server_relay->get_socket().async_send_to(
         asio::buffer(this->client_buffer.data(), this->udp_length),
         this->udp_dst_endpoint,
-        [this, self](asio::error_code ec, size_t length) {
-            if (!ec) {
-                SPDLOG_TRACE("Proxy {} -> UDP Server {} Data Length = {}",
-                             convert::format_address(this->udp_bnd_endpoint),
-                             convert::format_address(this->udp_dst_endpoint),
-                             length);
-
-                this->keep_alive();
-                this->receive_udp_message();
-            } else {
-                SPDLOG_WARN("Failed to send message to UDP Server {}",
-                            convert::format_address(this->udp_dst_endpoint));
-                this->stop();
-            }
-        });
+        make_custom_alloc_handler(
+            this->dst_handler_memory,
+            [this, self](asio::error_code ec, size_t length) {
+                if (!ec) {
+                    SESSION_TRACE("Proxy {} -> UDP Server {} Data Length = {}",
+                                  this->udp_bnd_endpoint,
+                                  this->udp_dst_endpoint, length);
+
+                    this->keep_alive();
+                    this->receive_udp_message();
+                } else {
+                    SPDLOG_WARN("Failed to send message to UDP Server {}",
+                                this->udp_dst_endpoint);
+                    this->stop();
+                }
+            }));
 }
 
 void Socks5Session::send_udp_to_client() {
-    this->dst_port = htons(this->dst_port);
-    std::array<asio::const_buffer, 5> buf = {
-        {asio::buffer(&this->udp_rsv, 2), asio::buffer(&this->frag, 1),
-         asio::buffer(&this->reply_atyp, 1),
+    // host octet order convert to network octet order
+    uint16_t port = htons(this->dst_port);
+    std::array<asio::const_buffer, 4> buf = {
+        {asio::buffer(udp_reply_prefix), asio::buffer(&this->reply_atyp, 1),
          asio::buffer(this->dst_addr.data(), this->dst_addr.size()),
-         asio::buffer(&this->dst_port, 2)}};
+         asio::buffer(&port, 2)}};
 
     size_t buf_bytes = 0;
     for (const auto& b : buf) {
@@ -971,119 +1480,147 @@ void Socks5Session::send_udp_to_client() {
 
     this->udp_length += buf_bytes;
 
-    auto self = shared_from_this();
-    this->udp_socket->async_send_to(
+    session_ptr self(this);
+    this->udp_relay->get_socket().async_send_to(
         asio::buffer(this->client_buffer.data(), this->udp_length),
         this->udp_cli_endpoint,
-        [this, self](asio::error_code ec, size_t length) {
-            if (!ec) {
-                SPDLOG_TRACE("Proxy {} -> UDP Client {} Data Length = {}",
-                             convert::format_address(this->udp_bnd_endpoint),
-                             convert::format_address(this->udp_cli_endpoint),
-                             length);
-
-                this->keep_alive();
-                this->receive_udp_message();
-            } else {
-                SPDLOG_WARN("Failed to send message to UDP Client {}",
-                            convert::format_address(this->udp_cli_endpoint));
+        make_custom_alloc_handler(
+            this->dst_handler_memory,
+            [this, self](asio::error_code ec, size_t length) {
+                if (!ec) {
+                    SESSION_TRACE("Proxy {} -> UDP Client {} Data Length = {}",
+                                  this->udp_bnd_endpoint,
+                                  this->udp_cli_endpoint, length);
+
+                    this->keep_alive();
+                    this->receive_udp_message();
+                } else {
+                    SPDLOG_WARN("Failed to send message to UDP Client {}",
+                                this->udp_cli_endpoint);
 
-                this->stop();
-            }
-        });
+                    this->stop();
+                }
+            }));
 }
 
 void Socks5Session::receive_udp_message() {
-    auto self = shared_from_this();
-    this->udp_socket->async_receive_from(
-        asio::buffer(this->client_buffer.data(), this->client_buffer.size()),
-        this->sender_endpoint,
-        [this, self](asio::error_code ec, size_t length) {
-            if (!ec) {
-                this->udp_length = length;
-
-                this->keep_alive();
-                if (this->sender_endpoint == this->udp_cli_endpoint) {
-                    SPDLOG_TRACE(
-                        "UDP Client {} -> Proxy {} Data Length = {}",
-                        convert::format_address(this->udp_cli_endpoint),
-                        convert::format_address(this->udp_bnd_endpoint),
-                        length);
-
-                    this->parse_udp_message();
-                } else if (this->sender_endpoint == this->udp_dst_endpoint) {
-                    SPDLOG_TRACE(
-                        "UDP Server {} -> Proxy {} Data Length = {}",
-                        convert::format_address(this->udp_dst_endpoint),
-                        convert::format_address(this->udp_bnd_endpoint),
-                        length);
-
-                    this->send_udp_to_client();
-                } else {
-                    // unkown vistor (ignore)
-                    this->receive_udp_message();
-                }
-
-            } else {
-                SPDLOG_WARN("Failed to receive UDP message");
-                this->stop();
-            }
-        });
-}
+    // stopped while the last datagram was on its way
+    if (!this->udp_relay) {
+        return;
+    }
 
-void Socks5Session::connect_dst_host() {
-    auto self = shared_from_this();
-    this->dst_socket.async_connect(
-        this->tcp_dst_endpoint, [this, self](asio::error_code ec) {
-            if (!ec) {
-                try {
-                    this->tcp_bnd_endpoint = this->dst_socket.local_endpoint();
-                } catch (const asio::system_error&) {
-                    this->reply_and_stop(SocksV5::ReplyREP::ConnRefused);
-                    return;
-                }
+    this->udp_busy = false;
 
-                this->rep = SocksV5::ReplyREP::Succeeded;
+    if (this->udp_resolved) {
+        this->send_resolved_udp_message();
+    } else {
+        bool client_ready =
+            !this->udp_resolving && !this->udp_client_queue.empty();
+        bool server_ready = !this->udp_server_queue.empty();
+        if (client_ready && (this->udp_client_turn || !server_ready)) {
+            this->udp_client_turn = false;
+            this->udp_busy = true;
+            auto& datagram = this->udp_client_queue.front();
+            this->client_buffer.swap(datagram.data);
+            this->udp_length = datagram.length;
+            asio::ip::udp::endpoint sender = datagram.sender;
+            this->udp_client_queue.pop();
+            this->relay_udp_client_message(sender);
+        } else if (server_ready) {
+            this->udp_client_turn = true;
+            this->udp_busy = true;
+            auto& datagram = this->udp_server_queue.front();
+            this->client_buffer.swap(datagram.data);
+            this->udp_length = datagram.length;
+            asio::ip::udp::endpoint sender = datagram.sender;
+            this->udp_server_queue.pop();
+            this->relay_udp_server_message(sender);
+        }
+    }
 
-                this->set_reply_address(this->tcp_bnd_endpoint);
+    // private relay sockets hold back datagrams while the queues are full
+    if (this->udp_relay && !this->udp_relay->is_shared()) {
+        this->udp_relay->resume();
+    }
+    if (this->udp_server_relay && !this->udp_server_relay->is_shared()) {
+        this->udp_server_relay->resume();
+    }
+}
 
-                SPDLOG_DEBUG("Proxy {} -> Server {} Connection Successed",
-                             convert::format_address(this->tcp_bnd_endpoint),
-                             convert::format_address(this->tcp_dst_endpoint));
+void Socks5Session::connect_dst_host() {
+    if (!this->open_dst_socket()) {
+        this->reply_and_stop(SocksV5::ReplyREP::GenServFailed);
+        return;
+    }
 
-                this->reply_connect_result();
-            } else {
-                SPDLOG_DEBUG("Server {} Connection Failed",
-                             convert::format_address(this->tcp_dst_endpoint));
-                this->stop();
-            }
-        });
+    session_ptr self(this);
+    this->async_connect_dst(
+        make_custom_alloc_handler(
+            this->dst_handler_memory,
+            [this, self](asio::error_code ec) {
+                if (!ec) {
+                    try {
+                        this->tcp_bnd_endpoint =
+                            this->dst_socket.local_endpoint();
+                    } catch (const asio::system_error&) {
+                        this->reply_and_stop(SocksV5::ReplyREP::ConnRefused);
+                        return;
+                    }
+
+                    this->rep = SocksV5::ReplyREP::Succeeded;
+                    this->replied = true;
+
+                    this->set_reply_address(this->tcp_bnd_endpoint);
+
+                    SESSION_DEBUG("Proxy {} -> Server {} Connection Successed",
+                                  this->tcp_bnd_endpoint,
+                                  this->tcp_dst_endpoint);
+
+                    this->record_phase(latency::connect);
+                    this->connected_at = this->phase_at;
+                    this->reply_connect_result();
+                } else {
+                    SESSION_DEBUG("Server {} Connection Failed",
+                                  this->tcp_dst_endpoint);
+                    this->stats.add(metric::failed_connect);
+                    this->stop();
+                }
+            }));
 }
 
 void Socks5Session::async_dns_reslove() {
-    auto self = shared_from_this();
+    this->stats.add(metric::dns_lookups);
+
+    session_ptr self(this);
     this->udp_resolver.async_resolve(
         convert::dst_to_string(this->dst_addr, ATyp::DoMainName),
         std::to_string(this->dst_port),
-        [this, self](asio::error_code ec,
-                     const asio::ip::udp::resolver::results_type& result) {
-            if (!ec) {
-                this->resolve_results = result;
-                SPDLOG_DEBUG(
-                    "Reslove Domain {} {} result sets in total",
-                    convert::dst_to_string(this->dst_addr, ATyp::DoMainName),
-                    this->resolve_results.size());
-
-                this->try_to_connect_by_iterator(this->resolve_results.begin());
-            } else {
-                SPDLOG_WARN(
-                    "Failed to Reslove Domain {}, ERR_MSG = [{}]",
-                    convert::dst_to_string(this->dst_addr, ATyp::DoMainName),
-                    ec.message());
-
-                this->reply_and_stop(SocksV5::ReplyREP::HostUnreachable);
-            }
-        });
+        make_custom_alloc_handler(
+            this->resolve_handler_memory,
+            [this, self](asio::error_code ec,
+                         const asio::ip::udp::resolver::results_type& result) {
+                if (!ec) {
+                    this->resolve_results = result;
+                    SESSION_DEBUG(
+                        "Reslove Domain {} {} result sets in total",
+                        convert::dst_to_string(this->dst_addr,
+                                               ATyp::DoMainName),
+                        this->resolve_results.size());
+
+                    this->record_phase(latency::resolve);
+                    this->try_to_connect_by_iterator(
+                        this->resolve_results.begin());
+                } else {
+                    this->stats.add(metric::dns_failures);
+                    SPDLOG_WARN(
+                        "Failed to Reslove Domain {}, ERR_MSG = [{}]",
+                        convert::dst_to_string(this->dst_addr,
+                                               ATyp::DoMainName),
+                        ec.message());
+
+                    this->reply_and_stop(SocksV5::ReplyREP::HostUnreachable);
+                }
+            }));
 }
 
 void Socks5Session::try_to_connect_by_iterator(
@@ -1096,39 +1633,168 @@ void Socks5Session::try_to_connect_by_iterator(
     this->tcp_dst_endpoint = asio::ip::tcp::endpoint(iter->endpoint().address(),
                                                      iter->endpoint().port());
 
-    SPDLOG_DEBUG("Try to Connect {}",
-                 convert::format_address(this->tcp_dst_endpoint));
+    SESSION_DEBUG("Try to Connect {}", this->tcp_dst_endpoint);
 
     ++iter;
 
-    auto self = shared_from_this();
-    this->dst_socket.async_connect(
-        this->tcp_dst_endpoint, [this, self, iter](asio::error_code ec) {
-            if (!ec) {
-                try {
-                    this->tcp_bnd_endpoint = this->dst_socket.local_endpoint();
-                } catch (const asio::system_error&) {
-                    this->reply_and_stop(SocksV5::ReplyREP::ConnRefused);
-                    return;
+    if (!this->open_dst_socket()) {
+        this->reply_and_stop(SocksV5::ReplyREP::GenServFailed);
+        return;
+    }
+
+    session_ptr self(this);
+    this->async_connect_dst(
+        make_custom_alloc_handler(
+            this->dst_handler_memory,
+            [this, self, iter](asio::error_code ec) {
+                if (!ec) {
+                    try {
+                        this->tcp_bnd_endpoint =
+                            this->dst_socket.local_endpoint();
+                    } catch (const asio::system_error&) {
+                        this->reply_and_stop(SocksV5::ReplyREP::ConnRefused);
+                        return;
+                    }
+
+                    this->rep = SocksV5::ReplyREP::Succeeded;
+                    this->replied = true;
+
+                    this->set_reply_address(this->tcp_bnd_endpoint);
+
+                    SESSION_DEBUG("Proxy {} -> Server {} Connection Successed",
+                                  this->tcp_bnd_endpoint,
+                                  this->tcp_dst_endpoint);
+
+                    this->record_phase(latency::connect);
+                    this->connected_at = this->phase_at;
+                    this->reply_connect_result();
+                } else {
+                    this->try_to_connect_by_iterator(iter);
                 }
+            }));
+}
 
-                this->rep = SocksV5::ReplyREP::Succeeded;
+bool Socks5Session::open_dst_socket() {
+    asio::error_code ec;
+    // a failed attempt leaves the socket open, the next endpoint may also be
+    // of the other protocol
+    this->dst_socket.close(ec);
+    this->dst_socket.open(this->tcp_dst_endpoint.protocol(), ec);
+    if (ec) {
+        SPDLOG_WARN("Failed to Open Upstream Socket, ERR_MSG = [{}]",
+                    ec.message());
+        return false;
+    }
 
-                this->set_reply_address(this->tcp_bnd_endpoint);
+    ServerParser::global_config()->get_upstream_socket_options().apply(
+        this->dst_socket, ec);
+    if (ec) {
+        SESSION_DEBUG("Failed to Set Upstream {} Socket Options : {}",
+                      this->tcp_dst_endpoint, ec.message());
+    }
+    return true;
+}
 
-                SPDLOG_DEBUG("Proxy {} -> Server {} Connection Successed",
-                             convert::format_address(this->tcp_bnd_endpoint),
-                             convert::format_address(this->tcp_dst_endpoint));
+bool Socks5Session::send_early_data() {
+#if defined(MSG_FASTOPEN)
+    if (!this->upstream_fast_open) {
+        return false;
+    }
 
-                this->reply_connect_result();
-            } else {
-                this->try_to_connect_by_iterator(iter);
-            }
-        });
+    asio::error_code ec;
+    // the request was read to its last byte, anything left is pipelined
+    // data. It is kept for the next endpoint if this attempt fails.
+    if (this->early_data_length == 0) {
+        if (this->socket.available(ec) == 0 || ec) {
+            return false;
+        }
+
+        if (this->client_buffer.empty()) {
+            asio::use_service<buffer_pool>(this->ioc).acquire(
+                this->client_buffer);
+        }
+
+        this->early_data_length = this->socket.read_some(
+            asio::buffer(this->client_buffer.data(),
+                         this->client_buffer.size()),
+            ec);
+        if (ec) {
+            this->early_data_length = 0;
+            return false;
+        }
+        this->stats.add(metric::client_bytes, this->early_data_length);
+        this->client_bytes_read += this->early_data_length;
+    }
+
+    this->dst_socket.native_non_blocking(true, ec);
+    if (ec) {
+        return false;
+    }
+
+    // without a cookie for the server the data follows the handshake
+    ssize_t result = 0;
+    do {
+        result = ::sendto(this->dst_socket.native_handle(),
+                          this->client_buffer.data(), this->early_data_length,
+                          MSG_FASTOPEN | MSG_NOSIGNAL,
+                          this->tcp_dst_endpoint.data(),
+                          this->tcp_dst_endpoint.size());
+    } while (result < 0 && errno == EINTR);
+
+    if (result >= 0) {
+        this->early_data_sent = static_cast<size_t>(result);
+    } else if (errno == EINPROGRESS) {
+        this->early_data_sent = 0;
+    } else {
+        SESSION_DEBUG("Fast Open to Server {} Failed, ERR_MSG = [{}]",
+                      this->tcp_dst_endpoint, std::strerror(errno));
+        this->early_data_sent = 0;
+        return false;
+    }
+
+    SESSION_TRACE("Fast Open to Server {} Early Data Length = {}",
+                  this->tcp_dst_endpoint, this->early_data_sent);
+    return true;
+#else
+    return false;
+#endif
+}
+
+asio::error_code Socks5Session::get_connect_error() {
+    asio::detail::socket_option::integer<SOL_SOCKET, SO_ERROR> error;
+    asio::error_code ec;
+    this->dst_socket.get_option(error, ec);
+    if (!ec && error.value() != 0) {
+        ec = asio::error_code(error.value(),
+                              asio::error::get_system_category());
+    }
+    return ec;
+}
+
+void Socks5Session::relay_early_data() {
+    size_t length = this->early_data_length - this->early_data_sent;
+    if (length > 0) {
+        std::memmove(this->client_buffer.data(),
+                     this->client_buffer.data() + this->early_data_sent,
+                     length);
+    } else if (this->early_data_length > 0 && this->shared_relay_buffers) {
+        asio::use_service<buffer_pool>(this->ioc).release(this->client_buffer);
+    }
+
+    this->early_data_length = 0;
+    this->early_data_sent = 0;
+
+    if (length > 0) {
+        this->send_to_dst(length);
+    } else {
+        this->read_from_client();
+    }
 }
 
 void Socks5Session::reply_and_stop(SocksV5::ReplyREP rep) {
+    this->stats.add_failure(rep);
     this->rep = rep;
+    this->replied = true;
     this->reply_atyp = SocksV5::ReplyATYP::Ipv4;
     this->bnd_addr = {0, 0, 0, 0};
     this->bnd_port = 0;
@@ -1139,154 +1805,491 @@ void Socks5Session::reply_and_stop(SocksV5::ReplyREP rep) {
          asio::buffer(this->bnd_addr.data(), this->bnd_addr.size()),
          asio::buffer(&this->bnd_port, 2)}};
 
-    auto self = shared_from_this();
+    session_ptr self(this);
     asio::async_write(
         this->socket, buf,
-        [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
-            if (!ec) {
-                SPDLOG_DEBUG(
-                    "Proxy {} -> Client {} DATA : [VER = X'{:02x}', REP "
-                    "= X'{:02x}, RSV = X'{:02x}', ATYP = X'{:02x}', "
-                    "BND.ADDR = {}, BND.PORT = {}]",
-                    convert::format_address(this->local_endpoint),
-                    convert::format_address(this->tcp_cli_endpoint),
-                    static_cast<int16_t>(this->ver),
-                    static_cast<int16_t>(this->rep),
-                    static_cast<int16_t>(this->rsv),
-                    static_cast<int16_t>(this->reply_atyp),
-                    convert::dst_to_string(this->bnd_addr, ATyp::Ipv4),
-                    this->bnd_port);
+        make_custom_alloc_handler(
+            this->reply_handler_memory,
+            [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
+                if (!ec) {
+                    SESSION_DEBUG(
+                        "Proxy {} -> Client {} DATA : [VER = X'{:02x}', REP "
+                        "= X'{:02x}, RSV = X'{:02x}', ATYP = X'{:02x}', "
+                        "BND.ADDR = {}, BND.PORT = {}]",
+                        this->local_text, this->cli_text,
+                        static_cast<int16_t>(this->ver),
+                        static_cast<int16_t>(this->rep),
+                        static_cast<int16_t>(this->rsv),
+                        static_cast<int16_t>(this->reply_atyp),
+                        convert::dst_to_string(this->bnd_addr, ATyp::Ipv4),
+                        this->bnd_port);
 
-                this->stop();
-            } else {
-                SPDLOG_DEBUG("Client {} Closed",
-                             convert::format_address(this->tcp_cli_endpoint));
-                this->stop();
-            }
-        });
+                    this->stop();
+                } else {
+                    SESSION_DEBUG("Client {} Closed", this->cli_text);
+                    this->stop();
+                }
+            }));
 }
 
 void Socks5Session::reply_connect_result() {
-    std::array<asio::const_buffer, 6> buf = {
+    asio::error_code ec;
+    if (this->shared_relay_buffers) {
+        // relay reads must not block once woken up
+        this->socket.non_blocking(true, ec);
+        this->dst_socket.non_blocking(true, ec);
+    } else {
+        this->client_buffer.resize(this->relay_buffer_size);
+        this->dst_buffer.resize(this->relay_buffer_size);
+    }
+
+    if (this->zerocopy_threshold > 0) {
+        this->client_zerocopy.enable(this->socket);
+        this->dst_zerocopy.enable(this->dst_socket);
+    }
+
+    this->keep_alive();
+
+    this->reply_state = ReplyState::Deferred;
+    this->relay_early_data();
+    this->read_from_dst();
+
+    // a silent server must not hold the reply back, even from a client that
+    // sent data behind the request and does not wait for it
+    if (this->connect_reply_delay == 0) {
+        this->write_connect_reply(0);
+        return;
+    }
+
+    session_ptr self(this);
+    this->reply_timer.expires_after(
+        asio::chrono::milliseconds(this->connect_reply_delay));
+    this->reply_timer.async_wait(make_custom_alloc_handler(
+        this->timer_handler_memory, [this, self](asio::error_code ec) {
+            if (!ec && this->reply_state == ReplyState::Deferred) {
+                this->write_connect_reply(0);
+            }
+        }));
+}
+
+void Socks5Session::write_connect_reply(size_t write_length) {
+    asio::error_code ignored_ec;
+    this->reply_timer.cancel(ignored_ec);
+    this->reply_state = ReplyState::Writing;
+
+    std::array<asio::const_buffer, 7> buf = {
         {asio::buffer(&this->ver, 1), asio::buffer(&this->rep, 1),
          asio::buffer(&this->rsv, 1), asio::buffer(&this->reply_atyp, 1),
          asio::buffer(this->bnd_addr.data(), this->bnd_addr.size()),
-         asio::buffer(&this->bnd_port, 2)}};
+         asio::buffer(&this->bnd_port, 2),
+         asio::buffer(this->dst_buffer.data(), write_length)}};
 
-    auto self = shared_from_this();
+    session_ptr self(this);
     asio::async_write(
         this->socket, buf,
-        [this, self](asio::error_code ec, size_t /*bytes_transferred*/) {
-            if (!ec) {
-                SPDLOG_DEBUG(
+        make_custom_alloc_handler(
+            this->reply_handler_memory,
+            [this, self, write_length](asio::error_code ec,
+                                       size_t /*bytes_transferred*/) {
+                if (this->shared_relay_buffers && write_length > 0) {
+                    asio::use_service<buffer_pool>(this->ioc).release(
+                        this->dst_buffer);
+                }
+
+                if (ec) {
+                    SESSION_DEBUG("Client {} Closed", this->cli_text);
+                    this->stop();
+                    return;
+                }
+
+                SESSION_DEBUG(
                     "Proxy {} -> Client {} DATA : [VER = X'{:02x}', REP "
                     "= X'{:02x}, RSV = X'{:02x}', ATYP = X'{:02x}', "
-                    "BND.ADDR = {}, BND.PORT = {}]",
-                    convert::format_address(this->local_endpoint),
-                    convert::format_address(this->tcp_cli_endpoint),
+                    "BND.ADDR = {}, BND.PORT = {}] Data Length = {}",
+                    this->local_text, this->cli_text,
                     static_cast<int16_t>(this->ver),
                     static_cast<int16_t>(this->rep),
                     static_cast<int16_t>(this->rsv),
                     static_cast<int16_t>(this->reply_atyp),
                     this->tcp_bnd_endpoint.address().to_string(),
-                    this->tcp_bnd_endpoint.port());
-
-                this->client_buffer.resize(BUFSIZ);
-                this->dst_buffer.resize(BUFSIZ);
-
-                this->keep_alive();
-
-                this->read_from_client();
-                this->read_from_dst();
-            } else {
-                SPDLOG_DEBUG("Client {} Closed",
-                             convert::format_address(this->tcp_cli_endpoint));
-                this->stop();
-            }
-        });
+                    this->tcp_bnd_endpoint.port(), write_length);
+
+                this->reply_state = ReplyState::None;
+
+                auto now = std::chrono::steady_clock::now();
+                this->stats.observe(latency::reply, now - this->connected_at);
+                this->stats.observe(latency::setup, now - this->accepted_at);
+
+                if (this->dst_relay_done) {
+                    this->shutdown_dst_relay();
+                } else if (write_length > 0) {
+                    this->keep_alive();
+                    this->read_from_dst();
+                } else if (this->pending_dst_length > 0) {
+                    size_t length = this->pending_dst_length;
+                    this->pending_dst_length = 0;
+                    this->send_to_client(length);
+                }
+            }));
 }
 
 void Socks5Session::read_from_client() {
-    auto self = shared_from_this();
+    if (this->shared_relay_buffers) {
+        this->wait_from_client();
+        return;
+    }
+
+    // the previous buffer is held by the zerocopy sender
+    if (this->client_buffer.empty()) {
+        asio::use_service<buffer_pool>(this->ioc).acquire(this->client_buffer);
+    }
+
+    session_ptr self(this);
     this->socket.async_read_some(
         asio::buffer(this->client_buffer.data(), this->client_buffer.size()),
-        [this, self](asio::error_code ec, size_t length) {
-            if (!ec) {
-                SPDLOG_TRACE("Client {} -> Proxy {} Data Length = {}",
-                             convert::format_address(this->tcp_cli_endpoint),
-                             convert::format_address(this->local_endpoint),
-                             length);
-
-                this->keep_alive();
-                this->send_to_dst(length);
-            } else {
-                SPDLOG_TRACE("Client {} Closed",
-                             convert::format_address(this->tcp_cli_endpoint));
-                this->stop();
-            }
-        });
+        make_custom_alloc_handler(
+            this->client_handler_memory,
+            [this, self](asio::error_code ec, size_t length) {
+                if (!ec) {
+                    SESSION_TRACE("Client {} -> Proxy {} Data Length = {}",
+                                  this->cli_text, this->local_text, length);
+
+                    this->stats.add(metric::client_bytes, length);
+                    this->client_bytes_read += length;
+                    this->keep_alive();
+                    this->send_to_dst(length);
+                } else if (ec == asio::error::eof) {
+                    this->shutdown_client_relay();
+                } else {
+                    SESSION_TRACE("Client {} Closed", this->cli_text);
+                    this->stop();
+                }
+            }));
+}
+
+void Socks5Session::wait_from_client() {
+    session_ptr self(this);
+    this->socket.async_wait(
+        asio::ip::tcp::socket::wait_read,
+        make_custom_alloc_handler(
+            this->client_handler_memory, [this, self](asio::error_code ec) {
+                if (ec) {
+                    SESSION_TRACE("Client {} Closed", this->cli_text);
+                    this->stop();
+                    return;
+                }
+
+                auto& pool = asio::use_service<buffer_pool>(this->ioc);
+                pool.acquire(this->client_buffer);
+
+                size_t length = this->socket.read_some(
+                    asio::buffer(this->client_buffer.data(),
+                                 this->client_buffer.size()),
+                    ec);
+                if (ec == asio::error::would_block) {
+                    pool.release(this->client_buffer);
+                    this->wait_from_client();
+                } else if (!ec) {
+                    SESSION_TRACE("Client {} -> Proxy {} Data Length = {}",
+                                  this->cli_text, this->local_text, length);
+
+                    this->stats.add(metric::client_bytes, length);
+                    this->client_bytes_read += length;
+                    this->keep_alive();
+                    this->send_to_dst(length);
+                } else if (ec == asio::error::eof) {
+                    pool.release(this->client_buffer);
+                    this->shutdown_client_relay();
+                } else {
+                    pool.release(this->client_buffer);
+                    SESSION_TRACE("Client {} Closed", this->cli_text);
+                    this->stop();
+                }
+            }));
 }
 
 void Socks5Session::send_to_dst(size_t write_length) {
-    auto self = shared_from_this();
+    if (this->dst_zerocopy.is_enabled() &&
+        write_length >= this->zerocopy_threshold) {
+        this->send_zerocopy(this->dst_socket, this->dst_zerocopy,
+                            this->client_buffer, 0, write_length,
+                            &Socks5Session::read_from_client);
+        return;
+    }
+
+    session_ptr self(this);
     asio::async_write(
         this->dst_socket,
         asio::buffer(this->client_buffer.data(), write_length),
-        [this, self](asio::error_code ec, size_t length) {
-            if (!ec) {
-                SPDLOG_TRACE("Proxy {} -> Server {} Data Length = {}",
-                             convert::format_address(this->tcp_bnd_endpoint),
-                             convert::format_address(this->tcp_dst_endpoint),
-                             length);
-
-                this->keep_alive();
-                this->read_from_client();
-            } else {
-                SPDLOG_TRACE("Server {} Closed",
-                             convert::format_address(this->tcp_dst_endpoint));
-                this->stop();
-            }
-        });
+        make_custom_alloc_handler(
+            this->client_handler_memory,
+            [this, self](asio::error_code ec, size_t length) {
+                if (this->shared_relay_buffers) {
+                    asio::use_service<buffer_pool>(this->ioc).release(
+                        this->client_buffer);
+                }
+
+                if (!ec) {
+                    SESSION_TRACE("Proxy {} -> Server {} Data Length = {}",
+                                  this->tcp_bnd_endpoint,
+                                  this->tcp_dst_endpoint, length);
+
+                    this->keep_alive();
+                    this->read_from_client();
+                } else {
+                    SESSION_TRACE("Server {} Closed", this->tcp_dst_endpoint);
+                    this->stop();
+                }
+            }));
 }
 
 void Socks5Session::read_from_dst() {
-    auto self = shared_from_this();
+    if (this->shared_relay_buffers) {
+        this->wait_from_dst();
+        return;
+    }
+
+    if (this->dst_buffer.empty()) {
+        asio::use_service<buffer_pool>(this->ioc).acquire(this->dst_buffer);
+    }
+
+    session_ptr self(this);
     this->dst_socket.async_read_some(
         asio::buffer(this->dst_buffer.data(), this->dst_buffer.size()),
-        [this, self](asio::error_code ec, size_t length) {
-            if (!ec) {
-                SPDLOG_TRACE("Server {} -> Proxy {} Data Length = {}",
-                             convert::format_address(this->tcp_dst_endpoint),
-                             convert::format_address(this->tcp_bnd_endpoint),
-                             length);
-
-                this->keep_alive();
-                this->send_to_client(length);
-            } else {
-                SPDLOG_TRACE("Server {} Closed",
-                             convert::format_address(this->tcp_dst_endpoint));
-                this->stop();
-            }
-        });
+        make_custom_alloc_handler(
+            this->dst_handler_memory,
+            [this, self](asio::error_code ec, size_t length) {
+                if (!ec) {
+                    SESSION_TRACE("Server {} -> Proxy {} Data Length = {}",
+                                  this->tcp_dst_endpoint,
+                                  this->tcp_bnd_endpoint, length);
+
+                    this->stats.add(metric::upstream_bytes, length);
+                    this->upstream_bytes_read += length;
+                    this->keep_alive();
+                    this->send_to_client(length);
+                } else if (ec == asio::error::eof) {
+                    this->shutdown_dst_relay();
+                } else {
+                    SESSION_TRACE("Server {} Closed", this->tcp_dst_endpoint);
+                    this->stop();
+                }
+            }));
+}
+
+void Socks5Session::wait_from_dst() {
+    session_ptr self(this);
+    this->dst_socket.async_wait(
+        asio::ip::tcp::socket::wait_read,
+        make_custom_alloc_handler(
+            this->dst_handler_memory, [this, self](asio::error_code ec) {
+                if (ec) {
+                    SESSION_TRACE("Server {} Closed", this->tcp_dst_endpoint);
+                    this->stop();
+                    return;
+                }
+
+                auto& pool = asio::use_service<buffer_pool>(this->ioc);
+                pool.acquire(this->dst_buffer);
+
+                size_t length = this->dst_socket.read_some(
+                    asio::buffer(this->dst_buffer.data(),
+                                 this->dst_buffer.size()),
+                    ec);
+                if (ec == asio::error::would_block) {
+                    pool.release(this->dst_buffer);
+                    this->wait_from_dst();
+                } else if (!ec) {
+                    SESSION_TRACE("Server {} -> Proxy {} Data Length = {}",
+                                  this->tcp_dst_endpoint,
+                                  this->tcp_bnd_endpoint, length);
+
+                    this->stats.add(metric::upstream_bytes, length);
+                    this->upstream_bytes_read += length;
+                    this->keep_alive();
+                    this->send_to_client(length);
+                } else if (ec == asio::error::eof) {
+                    pool.release(this->dst_buffer);
+                    this->shutdown_dst_relay();
+                } else {
+                    pool.release(this->dst_buffer);
+                    SESSION_TRACE("Server {} Closed", this->tcp_dst_endpoint);
+                    this->stop();
+                }
+            }));
+}
+
+void Socks5Session::shutdown_client_relay() {
+    SESSION_TRACE("Client {} Finished Sending", this->cli_text);
+
+    asio::error_code ignored_ec;
+    this->client_relay_done = true;
+    this->dst_socket.shutdown(asio::ip::tcp::socket::shutdown_send,
+                              ignored_ec);
+    if (this->dst_relay_done) {
+        this->stop();
+    }
+}
+
+void Socks5Session::shutdown_dst_relay() {
+    SESSION_TRACE("Server {} Finished Sending", this->tcp_dst_endpoint);
+
+    this->dst_relay_done = true;
+    if (this->reply_state == ReplyState::Deferred) {
+        // the client still gets the reply, the write completion comes back
+        this->write_connect_reply(0);
+        return;
+    }
+    if (this->reply_state == ReplyState::Writing) {
+        return;
+    }
+
+    asio::error_code ignored_ec;
+    this->socket.shutdown(asio::ip::tcp::socket::shutdown_send, ignored_ec);
+    if (this->client_relay_done) {
+        this->stop();
+    }
 }
 
 void Socks5Session::send_to_client(size_t write_length) {
-    auto self = shared_from_this();
+    if (!this->first_byte_seen) {
+        this->first_byte_seen = true;
+        this->stats.observe(latency::first_byte,
+                            std::chrono::steady_clock::now() -
+                                this->connected_at);
+    }
+    if (this->reply_state == ReplyState::Deferred) {
+        this->write_connect_reply(write_length);
+        return;
+    }
+    if (this->reply_state == ReplyState::Writing) {
+        // sent once the reply write completes
+        this->pending_dst_length = write_length;
+        return;
+    }
+
+    if (this->client_zerocopy.is_enabled() &&
+        write_length >= this->zerocopy_threshold) {
+        this->send_zerocopy(this->socket, this->client_zerocopy,
+                            this->dst_buffer, 0, write_length,
+                            &Socks5Session::read_from_dst);
+        return;
+    }
+
+    session_ptr self(this);
     asio::async_write(
         this->socket, asio::buffer(this->dst_buffer.data(), write_length),
-        [this, self](asio::error_code ec, size_t length) {
+        make_custom_alloc_handler(
+            this->dst_handler_memory,
+            [this, self](asio::error_code ec, size_t length) {
+                if (this->shared_relay_buffers) {
+                    asio::use_service<buffer_pool>(this->ioc).release(
+                        this->dst_buffer);
+                }
+
+                if (!ec) {
+                    SESSION_TRACE("Proxy {} -> Client {} Data Length = {}",
+                                  this->local_text, this->cli_text, length);
+
+                    this->keep_alive();
+                    this->read_from_dst();
+                } else {
+                    SESSION_TRACE("Client {} Closed", this->cli_text);
+                    this->stop();
+                }
+            }));
+}
+
+void Socks5Session::send_zerocopy(asio::ip::tcp::socket& socket,
+                                  zerocopy_sender& sender,
+                                  std::vector<uint8_t>& buffer, size_t offset,
+                                  size_t write_length,
+                                  void (Socks5Session::*read_next)()) {
+    asio::error_code ec;
+    while (offset < write_length && !ec) {
+        offset += sender.send(socket, buffer.data() + offset,
+                              write_length - offset, ec);
+    }
+
+    if (ec == asio::error::would_block) {
+        session_ptr self(this);
+        socket.async_wait(
+            asio::ip::tcp::socket::wait_write,
+            [this, self, &socket, &sender, &buffer, offset, write_length,
+             read_next](asio::error_code ec) {
+                if (!ec) {
+                    this->send_zerocopy(socket, sender, buffer, offset,
+                                        write_length, read_next);
+                } else {
+                    // the lingering socket is closed once the wait sees the
+                    // kernel done with the buffer
+                    sender.hold(buffer,
+                                asio::use_service<buffer_pool>(this->ioc));
+                    this->wait_zerocopy(socket, sender);
+                    this->stop();
+                }
+            });
+        return;
+    }
+
+    // the sends made so far may still read the buffer
+    sender.hold(buffer, asio::use_service<buffer_pool>(this->ioc));
+    this->wait_zerocopy(socket, sender);
+
+    if (!ec) {
+        SESSION_TRACE("Zero Copy Send Data Length = {}", write_length);
+
+        this->keep_alive();
+        (this->*read_next)();
+    } else {
+        SESSION_TRACE("Zero Copy Send Failed, ERR_MSG = [{}]", ec.message());
+        this->stop();
+    }
+}
+
+void Socks5Session::wait_zerocopy(asio::ip::tcp::socket& socket,
+                                  zerocopy_sender& sender) {
+    if (sender.is_waiting() || !sender.has_pending()) {
+        return;
+    }
+
+    sender.set_waiting(true);
+
+    session_ptr self(this);
+    socket.async_wait(
+        asio::ip::tcp::socket::wait_error,
+        [this, self, &socket, &sender](asio::error_code ec) {
+            sender.set_waiting(false);
+            if (!socket.is_open()) {
+                return;
+            }
+
             if (!ec) {
-                SPDLOG_TRACE("Proxy {} -> Client {} Data Length = {}",
-                             convert::format_address(this->local_endpoint),
-                             convert::format_address(this->tcp_cli_endpoint),
-                             length);
-
-                this->keep_alive();
-                this->read_from_dst();
-            } else {
-                SPDLOG_TRACE("Client {} Closed",
-                             convert::format_address(this->tcp_cli_endpoint));
-                this->stop();
+                sender.complete(socket,
+                                asio::use_service<buffer_pool>(this->ioc));
+            }
+
+            if (sender.has_pending()) {
+                this->wait_zerocopy(socket, sender);
+            } else if (sender.is_lingering()) {
+                this->close_relay_socket(socket, sender);
             }
         });
+}
+
+void Socks5Session::close_relay_socket(asio::ip::tcp::socket& socket,
+                                       zerocopy_sender& sender) {
+    asio::error_code ignored_ec;
+    if (sender.has_pending() && socket.is_open()) {
+        if (!sender.is_lingering()) {
+            sender.linger();
+            socket.shutdown(asio::ip::tcp::socket::shutdown_both, ignored_ec);
+            // aborts the relay, the error queue wait is started again
+            socket.cancel(ignored_ec);
+        }
+        return;
+    }
+
+    socket.close(ignored_ec);
+    sender.clear();
 }
\ No newline at end of file
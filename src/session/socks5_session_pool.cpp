@@ -0,0 +1,47 @@
+#include "session/socks5_session_pool.h"
+
+asio::execution_context::id Socks5SessionPool::id;
+
+Socks5SessionPool::Socks5SessionPool(asio::io_context& ioc)
+    : asio::execution_context::service(ioc),
+      ioc(ioc),
+      stopped(false),
+      capacity(ServerParser::global_config()->get_session_pool_size()) {
+    free_sessions.reserve(capacity);
+}
+
+Socks5SessionPool::~Socks5SessionPool() { this->shutdown(); }
+
+session_ptr Socks5SessionPool::acquire(asio::ip::tcp::socket&& socket) {
+    Socks5Session* session = nullptr;
+    if (!free_sessions.empty()) {
+        session = free_sessions.back();
+        free_sessions.pop_back();
+    } else {
+        session = new Socks5Session(this->ioc, this);
+    }
+
+    session->get_socket() = std::move(socket);
+
+    return session_ptr(session);
+}
+
+void Socks5SessionPool::release(Socks5Session* session) {
+    if (stopped || free_sessions.size() >= capacity) {
+        delete session;
+        return;
+    }
+
+    session->reset();
+    free_sessions.push_back(session);
+}
+
+// sessions still referenced by pending handlers are released after this,
+// while the io_context destroys its handlers, and are deleted right away
+void Socks5SessionPool::shutdown() {
+    stopped = true;
+    for (auto session : free_sessions) {
+        delete session;
+    }
+    free_sessions.clear();
+}
\ No newline at end of file
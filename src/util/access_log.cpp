@@ -0,0 +1,269 @@
+#include "util/access_log.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "util/worker_metrics.h"
+
+namespace {
+
+// written files are flushed once this much is buffered
+const size_t write_buffer_size = 64 * 1024;
+
+template <typename Integer>
+uint8_t* put(uint8_t* out, Integer value) {
+    for (size_t i = 0; i < sizeof(Integer); i++) {
+        *out++ = static_cast<uint8_t>(value >> (i * 8));
+    }
+    return out;
+}
+
+template <typename Integer>
+const uint8_t* get(const uint8_t* data, Integer& value) {
+    value = 0;
+    for (size_t i = 0; i < sizeof(Integer); i++) {
+        value |= static_cast<Integer>(static_cast<Integer>(data[i]) << (i * 8));
+    }
+    return data + sizeof(Integer);
+}
+
+uint8_t* put_bytes(uint8_t* out, const uint8_t* data, size_t length) {
+    std::memcpy(out, data, length);
+    return out + length;
+}
+
+}    // namespace
+
+void access_record::set_times(
+    std::chrono::steady_clock::time_point accepted_at) {
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    auto elapsed = std::chrono::steady_clock::now() - accepted_at;
+    auto started = std::chrono::system_clock::now() - elapsed;
+    this->duration =
+        static_cast<uint64_t>(duration_cast<microseconds>(elapsed).count());
+    this->start_time = static_cast<uint64_t>(
+        duration_cast<microseconds>(started.time_since_epoch()).count());
+}
+
+void access_record::set_client(const asio::ip::tcp::endpoint& endpoint) {
+    if (endpoint.address().is_v4()) {
+        auto&& bytes = endpoint.address().to_v4().to_bytes();
+        std::memcpy(this->client_address, bytes.data(), bytes.size());
+        this->client_address_length = static_cast<uint8_t>(bytes.size());
+    } else {
+        auto&& bytes = endpoint.address().to_v6().to_bytes();
+        std::memcpy(this->client_address, bytes.data(), bytes.size());
+        this->client_address_length = static_cast<uint8_t>(bytes.size());
+    }
+    this->client_port = endpoint.port();
+}
+
+void access_record::set_destination(uint8_t atyp,
+                                    const std::vector<uint8_t>& address,
+                                    uint16_t port) {
+    this->dst_atyp = atyp;
+    this->dst_length = static_cast<uint8_t>(
+        std::min(address.size(), sizeof(this->dst_address)));
+    std::memcpy(this->dst_address, address.data(), this->dst_length);
+    this->dst_port = port;
+}
+
+void access_record::set_username(const uint8_t* data, size_t length) {
+    this->username_length =
+        static_cast<uint8_t>(std::min(length, sizeof(this->username)));
+    std::memcpy(this->username, data, this->username_length);
+}
+
+namespace access_log_format {
+
+size_t encode(const access_record& record, uint8_t* out) {
+    uint8_t* p = out + 2;
+    p = put(p, record.start_time);
+    p = put(p, record.duration);
+    p = put(p, record.client_bytes);
+    p = put(p, record.upstream_bytes);
+    p = put(p, record.client_port);
+    p = put(p, record.client_address_length);
+    p = put_bytes(p, record.client_address, record.client_address_length);
+    p = put(p, record.cmd);
+    p = put(p, record.rep);
+    p = put(p, record.dst_atyp);
+    p = put(p, record.dst_length);
+    p = put_bytes(p, record.dst_address, record.dst_length);
+    p = put(p, record.dst_port);
+    p = put(p, record.username_length);
+    p = put_bytes(p, record.username, record.username_length);
+
+    size_t length = static_cast<size_t>(p - out);
+    put(out, static_cast<uint16_t>(length - 2));
+    return length;
+}
+
+bool decode(const uint8_t* data, size_t length, access_record& record) {
+    const uint8_t* end = data + length;
+    // fixed fields up to and including client_address_length
+    if (length < 4 * 8 + 2 + 1) {
+        return false;
+    }
+    data = get(data, record.start_time);
+    data = get(data, record.duration);
+    data = get(data, record.client_bytes);
+    data = get(data, record.upstream_bytes);
+    data = get(data, record.client_port);
+    data = get(data, record.client_address_length);
+
+    if (record.client_address_length > sizeof(record.client_address) ||
+        end - data < record.client_address_length + 4) {
+        return false;
+    }
+    std::memcpy(record.client_address, data, record.client_address_length);
+    data += record.client_address_length;
+    data = get(data, record.cmd);
+    data = get(data, record.rep);
+    data = get(data, record.dst_atyp);
+    data = get(data, record.dst_length);
+
+    if (end - data < record.dst_length + 3) {
+        return false;
+    }
+    std::memcpy(record.dst_address, data, record.dst_length);
+    data += record.dst_length;
+    data = get(data, record.dst_port);
+    data = get(data, record.username_length);
+
+    if (end - data != record.username_length) {
+        return false;
+    }
+    std::memcpy(record.username, data, record.username_length);
+    return true;
+}
+
+}    // namespace access_log_format
+
+access_log_writer* access_log_writer::getInstance() {
+    static access_log_writer writer;
+    return &writer;
+}
+
+access_log_writer::access_log_writer()
+    : enabled(false),
+      queue_size(0),
+      flush_interval(0),
+      file(nullptr),
+      stopped(false) {}
+
+bool access_log_writer::start(const std::string& file, size_t queue_size,
+                              std::chrono::milliseconds flush_interval) {
+    this->file = std::fopen(file.c_str(), "ab");
+    if (this->file == nullptr) {
+        return false;
+    }
+    // a new file starts with the magic
+    std::fseek(this->file, 0, SEEK_END);
+    if (std::ftell(this->file) == 0) {
+        std::fwrite(access_log_format::magic, 1,
+                    sizeof(access_log_format::magic), this->file);
+    }
+
+    this->queue_size = queue_size == 0 ? 1 : queue_size;
+    this->flush_interval = flush_interval;
+    this->buffer.resize(write_buffer_size);
+    this->enabled = true;
+    this->thread = std::thread(&access_log_writer::run, this);
+    return true;
+}
+
+void access_log_writer::stop() {
+    if (!this->enabled) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopped = true;
+    }
+    this->stopped_signal.notify_one();
+    this->thread.join();
+
+    this->drain();
+    std::fclose(this->file);
+    this->file = nullptr;
+    this->enabled = false;
+}
+
+std::shared_ptr<access_log_ring> access_log_writer::add_ring() {
+    if (!this->enabled) {
+        return nullptr;
+    }
+
+    auto ring = std::make_shared<access_log_ring>(this->queue_size);
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->rings.push_back(ring);
+    return ring;
+}
+
+void access_log_writer::run() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (!this->stopped) {
+        this->stopped_signal.wait_for(lock, this->flush_interval);
+
+        lock.unlock();
+        this->drain();
+        lock.lock();
+    }
+}
+
+size_t access_log_writer::drain() {
+    std::vector<std::shared_ptr<access_log_ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        rings = this->rings;
+    }
+
+    size_t written = 0;
+    size_t buffered = 0;
+    auto flush = [this, &buffered]() {
+        std::fwrite(this->buffer.data(), 1, buffered, this->file);
+        buffered = 0;
+    };
+
+    for (auto&& ring : rings) {
+        written += ring->consume([&](const access_record& record) {
+            if (this->buffer.size() - buffered <
+                access_log_format::max_record_size) {
+                flush();
+            }
+            buffered += access_log_format::encode(
+                record, this->buffer.data() + buffered);
+        });
+    }
+
+    if (buffered > 0) {
+        flush();
+    }
+    if (written > 0) {
+        std::fflush(this->file);
+    }
+    return written;
+}
+
+asio::execution_context::id access_log::id;
+
+access_log::access_log(asio::execution_context& context)
+    : asio::execution_context::service(context),
+      ring(access_log_writer::getInstance()->add_ring()),
+      stats(asio::use_service<worker_metrics>(context)) {}
+
+access_record* access_log::prepare() {
+    if (!ring) {
+        return nullptr;
+    }
+
+    access_record* record = ring->prepare();
+    if (record == nullptr) {
+        this->stats.add(metric::access_log_dropped);
+    }
+    return record;
+}
\ No newline at end of file
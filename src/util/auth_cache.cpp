@@ -0,0 +1,58 @@
+#include "util/auth_cache.h"
+
+#include "option/parser.h"
+
+asio::execution_context::id auth_cache::id;
+
+auth_cache::auth_cache(asio::execution_context& context)
+    : asio::execution_context::service(context) {
+    size_t size = ServerParser::global_config()->get_auth_cache_size();
+    if (size > 0) {
+        // a power of two, so the slot is a mask of the digest
+        size_t capacity = 1;
+        while (capacity < size) {
+            capacity <<= 1;
+        }
+        entry empty = {};
+        entries.assign(capacity, empty);
+    }
+}
+
+auth_cache::~auth_cache() { this->shutdown(); }
+
+bool auth_cache::check(const ServerParser& config, const uint8_t* uname,
+                       size_t ulen, const uint8_t* passwd, size_t plen) {
+    size_t ttl = config.get_auth_cache_ttl();
+    if (entries.empty() || ttl == 0) {
+        return config.check_credentials(uname, ulen, passwd, plen);
+    }
+
+    // ULEN first, so the username/password split is part of the digest
+    uint8_t digest[sha256::digest_size];
+    uint8_t length = static_cast<uint8_t>(ulen);
+    sha256 hash;
+    hash.update(&length, 1);
+    hash.update(uname, ulen);
+    hash.update(passwd, plen);
+    hash.final(digest);
+
+    size_t index = 0;
+    std::memcpy(&index, digest, sizeof(index));
+    entry& cached = entries[index & (entries.size() - 1)];
+
+    auto now = std::chrono::steady_clock::now();
+    if (cached.generation == config.get_generation() && now < cached.expiry &&
+        sha256::equal(cached.digest, digest)) {
+        return true;
+    }
+
+    if (!config.check_credentials(uname, ulen, passwd, plen)) {
+        return false;
+    }
+    cached.generation = config.get_generation();
+    cached.expiry = now + std::chrono::seconds(ttl);
+    std::memcpy(cached.digest, digest, sizeof(digest));
+    return true;
+}
+
+void auth_cache::shutdown() { entries.clear(); }
\ No newline at end of file
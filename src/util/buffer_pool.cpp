@@ -0,0 +1,45 @@
+#include "util/buffer_pool.h"
+
+#include "option/parser.h"
+
+namespace {
+
+// free buffers kept after a burst of transfers
+const size_t max_free_buffers = 1024;
+
+}    // namespace
+
+asio::execution_context::id buffer_pool::id;
+
+buffer_pool::buffer_pool(asio::io_context& ioc)
+    : asio::execution_context::service(ioc),
+      buffer_size(ServerParser::global_config()->get_relay_buffer_size()) {}
+
+buffer_pool::~buffer_pool() { this->shutdown(); }
+
+void buffer_pool::set_buffer_size(size_t size) {
+    if (size != buffer_size) {
+        buffer_size = size;
+        free_buffers.clear();
+    }
+}
+
+void buffer_pool::acquire(std::vector<uint8_t>& buffer) {
+    if (free_buffers.empty()) {
+        buffer.resize(buffer_size);
+        return;
+    }
+
+    buffer.swap(free_buffers.back());
+    free_buffers.pop_back();
+}
+
+void buffer_pool::release(std::vector<uint8_t>& buffer) {
+    if (buffer.size() == buffer_size &&
+        free_buffers.size() < max_free_buffers) {
+        free_buffers.emplace_back(std::move(buffer));
+    }
+    std::vector<uint8_t>().swap(buffer);
+}
+
+void buffer_pool::shutdown() { free_buffers.clear(); }
\ No newline at end of file
@@ -0,0 +1,201 @@
+#include "util/credential_store.h"
+
+#include <random>
+
+namespace {
+
+// FNV-1a
+uint64_t hash_username(const uint8_t* data, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// false unless hex is exactly an even number of hex digits fitting in out
+bool decode_hex(const std::string& hex, uint8_t* out, size_t capacity,
+                size_t& length) {
+    if (hex.size() % 2 != 0 || hex.size() / 2 > capacity) {
+        return false;
+    }
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        int high = hex_value(hex[i]);
+        int low = hex_value(hex[i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        out[i / 2] = static_cast<uint8_t>(high << 4 | low);
+    }
+    length = hex.size() / 2;
+    return true;
+}
+
+}    // namespace
+
+credential_store::credential_store() : slots(16, 0) {}
+
+bool credential_store::load_file(const std::string& file) {
+    std::ifstream f(file);
+    if (!f) {
+        std::printf("cannot open credentials file %s\n", file.c_str());
+        return false;
+    }
+
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(f, line)) {
+        ++line_number;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        // the username may not contain ':', the other fields never do
+        size_t first = line.find(':');
+        size_t second = line.find(':', first + 1);
+        size_t third = line.find(':', second + 1);
+        if (first == std::string::npos || second == std::string::npos ||
+            third == std::string::npos ||
+            line.find(':', third + 1) != std::string::npos) {
+            std::printf("%s:%zu: expected username:iterations:salt:hash\n",
+                        file.c_str(), line_number);
+            return false;
+        }
+
+        std::string username = line.substr(0, first);
+        std::string iterations = line.substr(first + 1, second - first - 1);
+        entry user;
+        size_t digest_length = 0;
+        char* iterations_end = nullptr;
+        unsigned long iteration_count =
+            std::strtoul(iterations.c_str(), &iterations_end, 10);
+        size_t salt_length = 0;
+
+        // SOCKS5 usernames are 1 to 255 bytes
+        if (username.empty() || username.size() > 255 ||
+            iterations.empty() || *iterations_end != '\0' ||
+            iteration_count == 0 || iteration_count > UINT32_MAX ||
+            !decode_hex(line.substr(second + 1, third - second - 1),
+                        user.salt, max_salt_length, salt_length) ||
+            !decode_hex(line.substr(third + 1), user.digest,
+                        sha256::digest_size, digest_length) ||
+            digest_length != sha256::digest_size) {
+            std::printf("%s:%zu: malformed credentials\n", file.c_str(),
+                        line_number);
+            return false;
+        }
+
+        user.hash = hash_username(
+            reinterpret_cast<const uint8_t*>(username.data()), username.size());
+        user.name_length = static_cast<uint8_t>(username.size());
+        user.salt_length = static_cast<uint8_t>(salt_length);
+        user.iterations = static_cast<uint32_t>(iteration_count);
+        if (!this->insert(user, username.data())) {
+            std::printf("%s:%zu: duplicate user %s\n", file.c_str(),
+                        line_number, username.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+bool credential_store::add_user(const std::string& username,
+                                const std::string& password,
+                                uint32_t iterations) {
+    if (username.empty() || username.size() > 255 || iterations == 0) {
+        return false;
+    }
+
+    entry user;
+    user.hash = hash_username(
+        reinterpret_cast<const uint8_t*>(username.data()), username.size());
+    user.name_length = static_cast<uint8_t>(username.size());
+    user.salt_length = 16;
+    user.iterations = iterations;
+
+    std::random_device random;
+    for (size_t i = 0; i < user.salt_length; i++) {
+        user.salt[i] = static_cast<uint8_t>(random());
+    }
+    pbkdf2_sha256(reinterpret_cast<const uint8_t*>(password.data()),
+                  password.size(), user.salt, user.salt_length, iterations,
+                  user.digest);
+
+    return this->insert(user, username.data());
+}
+
+bool credential_store::verify(const uint8_t* username, size_t username_length,
+                              const uint8_t* password,
+                              size_t password_length) const {
+    const entry* user = this->find(username, username_length,
+                                   hash_username(username, username_length));
+    if (user == nullptr) {
+        return false;
+    }
+
+    uint8_t digest[sha256::digest_size];
+    pbkdf2_sha256(password, password_length, user->salt, user->salt_length,
+                  user->iterations, digest);
+    return sha256::equal(digest, user->digest);
+}
+
+bool credential_store::insert(const entry& user, const char* username) {
+    if (this->find(reinterpret_cast<const uint8_t*>(username),
+                   user.name_length, user.hash) != nullptr) {
+        return false;
+    }
+    if ((entries.size() + 1) * 2 > slots.size()) {
+        this->grow();
+    }
+
+    entries.push_back(user);
+    entries.back().name_offset = static_cast<uint32_t>(names.size());
+    names.insert(names.end(), username, username + user.name_length);
+
+    size_t mask = slots.size() - 1;
+    size_t slot = user.hash & mask;
+    while (slots[slot] != 0) {
+        slot = (slot + 1) & mask;
+    }
+    slots[slot] = static_cast<uint32_t>(entries.size());
+    return true;
+}
+
+const credential_store::entry* credential_store::find(const uint8_t* username,
+                                                      size_t length,
+                                                      uint64_t hash) const {
+    size_t mask = slots.size() - 1;
+    for (size_t slot = hash & mask; slots[slot] != 0;
+         slot = (slot + 1) & mask) {
+        const entry& user = entries[slots[slot] - 1];
+        if (user.hash == hash && user.name_length == length &&
+            std::memcmp(&names[user.name_offset], username, length) == 0) {
+            return &user;
+        }
+    }
+    return nullptr;
+}
+
+void credential_store::grow() {
+    std::vector<uint32_t> grown(slots.size() * 2, 0);
+    size_t mask = grown.size() - 1;
+    for (size_t i = 0; i < entries.size(); i++) {
+        size_t slot = entries[i].hash & mask;
+        while (grown[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        grown[slot] = static_cast<uint32_t>(i + 1);
+    }
+    slots.swap(grown);
+}
\ No newline at end of file
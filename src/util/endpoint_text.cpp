@@ -0,0 +1,49 @@
+#include "util/endpoint_text.h"
+
+#include <cstring>
+
+namespace {
+
+char* write_decimal(char* out, unsigned value) {
+    char digits[10];
+    size_t count = 0;
+    do {
+        digits[count++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (count > 0) {
+        *out++ = digits[--count];
+    }
+    return out;
+}
+
+}    // namespace
+
+size_t write_endpoint_text(const asio::ip::address& address, uint16_t port,
+                           char* out) {
+    char* p = out;
+    if (address.is_v4()) {
+        auto&& bytes = address.to_v4().to_bytes();
+        for (size_t i = 0; i < bytes.size(); i++) {
+            if (i > 0) {
+                *p++ = '.';
+            }
+            p = write_decimal(p, bytes[i]);
+        }
+    } else {
+        asio::ip::address_v6 v6 = address.to_v6();
+        auto&& bytes = v6.to_bytes();
+        asio::error_code ec;
+        *p++ = '[';
+        // leaves room for "]:" and the port
+        if (asio::detail::socket_ops::inet_ntop(
+                ASIO_OS_DEF(AF_INET6), bytes.data(), p,
+                max_endpoint_text - 8, v6.scope_id(), ec) != nullptr) {
+            p += std::strlen(p);
+        }
+        *p++ = ']';
+    }
+    *p++ = ':';
+    p = write_decimal(p, port);
+    return static_cast<size_t>(p - out);
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include "util/latency_histogram.h"
+
+namespace {
+
+// index of the highest set bit, value must not be 0
+size_t highest_bit(uint64_t value) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(value);
+#else
+    size_t bit = 0;
+    while (value >>= 1) {
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+}    // namespace
+
+const size_t latency_histogram::sub_bucket_bits;
+const size_t latency_histogram::sub_buckets;
+const size_t latency_histogram::max_octave;
+const size_t latency_histogram::bucket_count;
+
+latency_histogram::latency_histogram() {
+    for (auto&& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    overflow.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+}
+
+size_t latency_histogram::bucket_index(uint64_t us) {
+    // the first sub_buckets values get a bucket each
+    if (us < sub_buckets) {
+        return static_cast<size_t>(us);
+    }
+
+    size_t octave = highest_bit(us);
+    if (octave > max_octave) {
+        return bucket_count;
+    }
+    size_t sub_bucket = (us >> (octave - sub_bucket_bits)) & (sub_buckets - 1);
+    return (octave - sub_bucket_bits + 1) * sub_buckets + sub_bucket;
+}
+
+uint64_t latency_histogram::bucket_limit(size_t index) {
+    if (index < sub_buckets) {
+        return index + 1;
+    }
+
+    size_t octave = index / sub_buckets + sub_bucket_bits - 1;
+    uint64_t width = uint64_t(1) << (octave - sub_bucket_bits);
+    return (uint64_t(1) << octave) + (index % sub_buckets + 1) * width;
+}
\ No newline at end of file
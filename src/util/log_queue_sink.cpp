@@ -0,0 +1,158 @@
+#include "util/log_queue_sink.h"
+
+#include <cstring>
+
+namespace {
+
+// the queue of the calling thread and the sink it belongs to
+struct thread_queue {
+    uint64_t sink_id;
+    void* queue;
+};
+
+thread_local thread_queue local = {0, nullptr};
+
+}    // namespace
+
+std::atomic<uint64_t> log_queue_sink::next_id(1);
+
+log_queue_sink::log_queue_sink(std::vector<spdlog::sink_ptr> sinks,
+                               size_t queue_size,
+                               std::chrono::milliseconds flush_interval)
+    : id(next_id.fetch_add(1)),
+      sinks(std::move(sinks)),
+      queue_size(queue_size == 0 ? 1 : queue_size),
+      flush_interval(flush_interval),
+      reported_dropped(0),
+      stopped(false) {
+    this->thread = std::thread(&log_queue_sink::run, this);
+}
+
+log_queue_sink::~log_queue_sink() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopped = true;
+    }
+    this->stopped_signal.notify_one();
+    this->thread.join();
+
+    this->drain();
+}
+
+void log_queue_sink::log(const spdlog::details::log_msg& msg) {
+    queue& q = this->local_queue();
+    log_entry* entry = q.ring.prepare();
+    if (entry == nullptr) {
+        q.dropped.store(q.dropped.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+        return;
+    }
+
+    entry->time = msg.time;
+    entry->source = msg.source;
+    entry->thread_id = msg.thread_id;
+    entry->level = msg.level;
+    if (msg.payload.size() <= log_entry::max_payload) {
+        entry->length = static_cast<uint16_t>(msg.payload.size());
+        std::memcpy(entry->payload, msg.payload.data(), entry->length);
+    } else {
+        entry->length = static_cast<uint16_t>(log_entry::max_payload);
+        std::memcpy(entry->payload, msg.payload.data(),
+                    log_entry::max_payload - 3);
+        std::memcpy(entry->payload + log_entry::max_payload - 3, "...", 3);
+    }
+    q.ring.commit();
+}
+
+void log_queue_sink::set_pattern(const std::string& pattern) {
+    for (auto&& sink : this->sinks) {
+        sink->set_pattern(pattern);
+    }
+}
+
+void log_queue_sink::set_formatter(
+    std::unique_ptr<spdlog::formatter> sink_formatter) {
+    for (auto&& sink : this->sinks) {
+        sink->set_formatter(sink_formatter->clone());
+    }
+}
+
+uint64_t log_queue_sink::dropped() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    uint64_t dropped = 0;
+    for (auto&& q : this->queues) {
+        dropped += q->dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
+}
+
+log_queue_sink::queue& log_queue_sink::local_queue() {
+    if (local.sink_id == this->id) {
+        return *static_cast<queue*>(local.queue);
+    }
+
+    // queues live as long as the sink, threads are few and long lived
+    std::unique_ptr<queue> q(new queue(this->queue_size));
+    local.sink_id = this->id;
+    local.queue = q.get();
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->queues.push_back(std::move(q));
+    return *this->queues.back();
+}
+
+void log_queue_sink::run() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (!this->stopped) {
+        this->stopped_signal.wait_for(lock, this->flush_interval);
+
+        lock.unlock();
+        this->drain();
+        lock.lock();
+    }
+}
+
+size_t log_queue_sink::drain() {
+    std::vector<queue*> queues;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        for (auto&& q : this->queues) {
+            queues.push_back(q.get());
+        }
+    }
+
+    size_t written = 0;
+    for (auto&& q : queues) {
+        written += q->ring.consume([this](const log_entry& entry) {
+            spdlog::details::log_msg msg(
+                entry.time, entry.source, spdlog::string_view_t(), entry.level,
+                spdlog::string_view_t(entry.payload, entry.length));
+            msg.thread_id = entry.thread_id;
+            for (auto&& sink : this->sinks) {
+                if (sink->should_log(msg.level)) {
+                    sink->log(msg);
+                }
+            }
+        });
+    }
+
+    uint64_t dropped = this->dropped();
+    if (dropped != this->reported_dropped) {
+        std::string text = std::to_string(dropped - this->reported_dropped) +
+                           " Log Messages Dropped, Queues Full";
+        spdlog::details::log_msg msg(spdlog::string_view_t(),
+                                     spdlog::level::warn, text);
+        for (auto&& sink : this->sinks) {
+            sink->log(msg);
+        }
+        this->reported_dropped = dropped;
+        written++;
+    }
+
+    if (written > 0) {
+        for (auto&& sink : this->sinks) {
+            sink->flush();
+        }
+    }
+    return written;
+}
\ No newline at end of file
@@ -0,0 +1,199 @@
+#include "util/sha256.h"
+
+#include <cstring>
+
+namespace {
+
+const uint32_t round_constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+inline uint32_t rotate_right(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+inline uint32_t load_be32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) |
+           (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+inline void store_be32(uint8_t* p, uint32_t x) {
+    p[0] = static_cast<uint8_t>(x >> 24);
+    p[1] = static_cast<uint8_t>(x >> 16);
+    p[2] = static_cast<uint8_t>(x >> 8);
+    p[3] = static_cast<uint8_t>(x);
+}
+
+// HMAC-SHA-256 with the padded key already absorbed into inner and outer,
+// copies of them are finished for every message
+void hmac_sha256(const sha256& inner, const sha256& outer,
+                 const uint8_t* data, size_t length, uint8_t* mac) {
+    uint8_t inner_digest[sha256::digest_size];
+    sha256 inner_hash(inner);
+    inner_hash.update(data, length);
+    inner_hash.final(inner_digest);
+
+    sha256 outer_hash(outer);
+    outer_hash.update(inner_digest, sizeof(inner_digest));
+    outer_hash.final(mac);
+}
+
+}    // namespace
+
+sha256::sha256()
+    : state{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f,
+            0x9b05688c, 0x1f83d9ab, 0x5be0cd19},
+      length(0),
+      buffered(0) {}
+
+void sha256::update(const void* data, size_t length) {
+    auto bytes = static_cast<const uint8_t*>(data);
+    this->length += length;
+
+    if (buffered > 0) {
+        size_t n = block_size - buffered;
+        if (n > length) n = length;
+        std::memcpy(buffer + buffered, bytes, n);
+        buffered += n;
+        bytes += n;
+        length -= n;
+        if (buffered < block_size) {
+            return;
+        }
+        this->transform(buffer);
+        buffered = 0;
+    }
+
+    for (; length >= block_size; bytes += block_size, length -= block_size) {
+        this->transform(bytes);
+    }
+
+    if (length > 0) {
+        std::memcpy(buffer, bytes, length);
+        buffered = length;
+    }
+}
+
+void sha256::final(uint8_t* digest) {
+    uint64_t bits = length * 8;
+
+    uint8_t padding[block_size * 2] = {0x80};
+    size_t padding_length = (buffered < 56) ? (56 - buffered)
+                                            : (block_size + 56 - buffered);
+    for (int i = 0; i < 8; i++) {
+        padding[padding_length + i] =
+            static_cast<uint8_t>(bits >> (56 - i * 8));
+    }
+    this->update(padding, padding_length + 8);
+
+    for (int i = 0; i < 8; i++) {
+        store_be32(digest + i * 4, state[i]);
+    }
+}
+
+bool sha256::equal(const uint8_t* a, const uint8_t* b) {
+    uint8_t diff = 0;
+    for (size_t i = 0; i < digest_size; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+void sha256::transform(const uint8_t* block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = load_be32(block + i * 4);
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotate_right(w[i - 15], 7) ^ rotate_right(w[i - 15], 18) ^
+                      (w[i - 15] >> 3);
+        uint32_t s1 = rotate_right(w[i - 2], 17) ^ rotate_right(w[i - 2], 19) ^
+                      (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 =
+            rotate_right(e, 6) ^ rotate_right(e, 11) ^ rotate_right(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + round_constants[i] + w[i];
+        uint32_t s0 =
+            rotate_right(a, 2) ^ rotate_right(a, 13) ^ rotate_right(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void pbkdf2_sha256(const uint8_t* password, size_t password_length,
+                   const uint8_t* salt, size_t salt_length,
+                   uint32_t iterations, uint8_t* key) {
+    // keys longer than a block are hashed first
+    uint8_t padded_key[sha256::block_size] = {0};
+    if (password_length > sha256::block_size) {
+        sha256 key_hash;
+        key_hash.update(password, password_length);
+        key_hash.final(padded_key);
+    } else if (password_length > 0) {
+        std::memcpy(padded_key, password, password_length);
+    }
+
+    uint8_t pad[sha256::block_size];
+    sha256 inner, outer;
+    for (size_t i = 0; i < sha256::block_size; i++) {
+        pad[i] = padded_key[i] ^ 0x36;
+    }
+    inner.update(pad, sizeof(pad));
+    for (size_t i = 0; i < sha256::block_size; i++) {
+        pad[i] = padded_key[i] ^ 0x5c;
+    }
+    outer.update(pad, sizeof(pad));
+
+    // U1 = HMAC(password, salt || INT(1))
+    static const uint8_t block_index[4] = {0, 0, 0, 1};
+    uint8_t u[sha256::digest_size];
+    sha256 first(inner);
+    first.update(salt, salt_length);
+    first.update(block_index, sizeof(block_index));
+    uint8_t inner_digest[sha256::digest_size];
+    first.final(inner_digest);
+    sha256 first_outer(outer);
+    first_outer.update(inner_digest, sizeof(inner_digest));
+    first_outer.final(u);
+    std::memcpy(key, u, sizeof(u));
+
+    for (uint32_t i = 1; i < iterations; i++) {
+        hmac_sha256(inner, outer, u, sizeof(u), u);
+        for (size_t j = 0; j < sizeof(u); j++) {
+            key[j] ^= u[j];
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include "util/socket_options.h"
+
+#if defined(__linux__)
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+namespace {
+
+template <int Name>
+using tcp_option = asio::detail::socket_option::integer<IPPROTO_TCP, Name>;
+
+template <typename Socket, typename Option>
+void set_option(Socket& socket, const Option& option, asio::error_code& ec) {
+    asio::error_code option_ec;
+    socket.set_option(option, option_ec);
+    if (option_ec) {
+        ec = option_ec;
+    }
+}
+
+template <typename Socket>
+void apply_options(Socket& socket, const socket_options& options,
+                   asio::error_code& ec) {
+    ec.clear();
+
+    if (options.no_delay) {
+        set_option(socket, asio::ip::tcp::no_delay(true), ec);
+    }
+    if (options.keep_alive) {
+        set_option(socket, asio::socket_base::keep_alive(true), ec);
+#if defined(TCP_KEEPIDLE)
+        if (options.keep_idle > 0) {
+            set_option(socket, tcp_option<TCP_KEEPIDLE>(options.keep_idle),
+                       ec);
+        }
+#endif
+#if defined(TCP_KEEPINTVL)
+        if (options.keep_interval > 0) {
+            set_option(socket,
+                       tcp_option<TCP_KEEPINTVL>(options.keep_interval), ec);
+        }
+#endif
+#if defined(TCP_KEEPCNT)
+        if (options.keep_count > 0) {
+            set_option(socket, tcp_option<TCP_KEEPCNT>(options.keep_count),
+                       ec);
+        }
+#endif
+    }
+    if (options.send_buffer_size > 0) {
+        set_option(socket,
+                   asio::socket_base::send_buffer_size(
+                       options.send_buffer_size),
+                   ec);
+    }
+    if (options.receive_buffer_size > 0) {
+        set_option(socket,
+                   asio::socket_base::receive_buffer_size(
+                       options.receive_buffer_size),
+                   ec);
+    }
+#if defined(TCP_NOTSENT_LOWAT)
+    if (options.notsent_lowat > 0) {
+        set_option(socket,
+                   tcp_option<TCP_NOTSENT_LOWAT>(options.notsent_lowat), ec);
+    }
+#endif
+#if defined(TCP_USER_TIMEOUT)
+    if (options.user_timeout > 0) {
+        set_option(socket, tcp_option<TCP_USER_TIMEOUT>(options.user_timeout),
+                   ec);
+    }
+#endif
+#if defined(TCP_CONGESTION)
+    if (!options.congestion_control.empty() &&
+        ::setsockopt(socket.native_handle(), IPPROTO_TCP, TCP_CONGESTION,
+                     options.congestion_control.data(),
+                     options.congestion_control.size()) != 0) {
+        ec = asio::error_code(errno, asio::error::get_system_category());
+    }
+#endif
+}
+
+}    // namespace
+
+socket_options::socket_options()
+    : no_delay(false),
+      keep_alive(false),
+      keep_idle(0),
+      keep_interval(0),
+      keep_count(0),
+      send_buffer_size(0),
+      receive_buffer_size(0),
+      notsent_lowat(0),
+      user_timeout(0),
+      fast_open(false),
+      fast_open_queue(256) {}
+
+void socket_options::apply(asio::ip::tcp::socket& socket,
+                           asio::error_code& ec) const {
+    apply_options(socket, *this, ec);
+}
+
+void socket_options::apply(asio::ip::tcp::acceptor& acceptor,
+                           asio::error_code& ec) const {
+    apply_options(acceptor, *this, ec);
+#if defined(TCP_FASTOPEN)
+    if (this->fast_open) {
+        set_option(acceptor, tcp_option<TCP_FASTOPEN>(this->fast_open_queue),
+                   ec);
+    }
+#endif
+}
\ No newline at end of file
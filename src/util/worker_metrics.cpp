@@ -0,0 +1,102 @@
+#include "util/worker_metrics.h"
+
+namespace {
+
+const metric_info metric_infos[] = {
+    {"socks_sessions_accepted_total", "", "counter",
+     "Client connections accepted."},
+    {"socks_sessions_active", "", "gauge",
+     "Client connections being served."},
+    {"socks_relay_bytes_total", "direction=\"client_to_upstream\"", "counter",
+     "Bytes relayed over TCP."},
+    {"socks_relay_bytes_total", "direction=\"upstream_to_client\"", "counter",
+     "Bytes relayed over TCP."},
+    {"socks_handshake_failures_total", "reason=\"version\"", "counter",
+     "Connections ended during the SOCKS handshake."},
+    {"socks_handshake_failures_total", "reason=\"method\"", "counter",
+     "Connections ended during the SOCKS handshake."},
+    {"socks_handshake_failures_total", "reason=\"auth\"", "counter",
+     "Connections ended during the SOCKS handshake."},
+    {"socks_handshake_failures_total", "reason=\"command\"", "counter",
+     "Connections ended during the SOCKS handshake."},
+    {"socks_handshake_failures_total", "reason=\"address_type\"", "counter",
+     "Connections ended during the SOCKS handshake."},
+    {"socks_handshake_failures_total", "reason=\"resolve\"", "counter",
+     "Connections ended during the SOCKS handshake."},
+    {"socks_handshake_failures_total", "reason=\"connect\"", "counter",
+     "Connections ended during the SOCKS handshake."},
+    {"socks_handshake_failures_total", "reason=\"server\"", "counter",
+     "Connections ended during the SOCKS handshake."},
+    {"socks_dns_lookups_total", "", "counter", "Domain name lookups."},
+    {"socks_dns_failures_total", "", "counter",
+     "Domain name lookups that failed."},
+    {"socks_udp_datagrams_total", "direction=\"client_to_upstream\"",
+     "counter", "UDP datagrams relayed."},
+    {"socks_udp_datagrams_total", "direction=\"upstream_to_client\"",
+     "counter", "UDP datagrams relayed."},
+    {"socks_udp_dropped_datagrams_total", "", "counter",
+     "UDP datagrams shared relay sockets dropped because their "
+     "association was busy."},
+    {"socks_access_log_dropped_total", "", "counter",
+     "Access log records dropped because the queue was full."},
+};
+
+static_assert(sizeof(metric_infos) / sizeof(metric_infos[0]) ==
+                  static_cast<size_t>(metric::count),
+              "every metric needs a description");
+
+const char* latency_phases[] = {
+    "greeting", "auth",  "request",    "resolve",
+    "connect",  "reply", "first_byte", "setup",
+};
+
+static_assert(sizeof(latency_phases) / sizeof(latency_phases[0]) ==
+                  static_cast<size_t>(latency::count),
+              "every phase needs a label");
+
+}    // namespace
+
+asio::execution_context::id worker_metrics::id;
+
+worker_metrics::worker_metrics(asio::execution_context& context)
+    : asio::execution_context::service(context) {
+    for (auto&& value : values) {
+        value.store(0, std::memory_order_relaxed);
+    }
+}
+
+const metric_info& worker_metrics::describe(metric m) {
+    return metric_infos[static_cast<size_t>(m)];
+}
+
+const char* worker_metrics::describe(latency l) {
+    return latency_phases[static_cast<size_t>(l)];
+}
+
+void worker_metrics::add_failure(SocksV5::ReplyREP rep) {
+    switch (rep) {
+        case SocksV5::ReplyREP::Succeeded:
+            return;
+
+        case SocksV5::ReplyREP::CommandNotSupported: {
+            this->add(metric::failed_command);
+        } break;
+
+        case SocksV5::ReplyREP::AddrTypeNotSupported: {
+            this->add(metric::failed_address_type);
+        } break;
+
+        case SocksV5::ReplyREP::HostUnreachable: {
+            this->add(metric::failed_resolve);
+        } break;
+
+        case SocksV5::ReplyREP::NetworkUnreachable:
+        case SocksV5::ReplyREP::ConnRefused: {
+            this->add(metric::failed_connect);
+        } break;
+
+        default: {
+            this->add(metric::failed_server);
+        } break;
+    }
+}
\ No newline at end of file
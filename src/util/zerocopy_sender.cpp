@@ -0,0 +1,174 @@
+#include "util/zerocopy_sender.h"
+
+#if defined(__linux__)
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && \
+    defined(SO_EE_ORIGIN_ZEROCOPY)
+#define SOCKS_HAS_ZEROCOPY 1
+#endif
+#endif
+
+zerocopy_sender::zerocopy_sender()
+    : enabled(false),
+      waiting(false),
+      lingering(false),
+      next_id(0),
+      hold_id(0),
+      unheld_completed(0) {}
+
+bool zerocopy_sender::enable(asio::ip::tcp::socket& socket) {
+    this->clear();
+
+#if defined(SOCKS_HAS_ZEROCOPY)
+    int one = 1;
+    if (::setsockopt(socket.native_handle(), SOL_SOCKET, SO_ZEROCOPY, &one,
+                     sizeof(one)) == 0) {
+        this->enabled = true;
+    }
+#else
+    (void)socket;
+#endif
+
+    return this->enabled;
+}
+
+size_t zerocopy_sender::send(asio::ip::tcp::socket& socket,
+                             const uint8_t* data, size_t length,
+                             asio::error_code& ec) {
+#if defined(SOCKS_HAS_ZEROCOPY)
+    ec.clear();
+
+    ssize_t result = 0;
+    do {
+        result = ::send(socket.native_handle(), data, length,
+                        MSG_ZEROCOPY | MSG_DONTWAIT | MSG_NOSIGNAL);
+    } while (result < 0 && errno == EINTR);
+
+    if (result >= 0) {
+        ++this->next_id;
+        return static_cast<size_t>(result);
+    }
+
+    if (errno == ENOBUFS) {
+        do {
+            result = ::send(socket.native_handle(), data, length,
+                            MSG_DONTWAIT | MSG_NOSIGNAL);
+        } while (result < 0 && errno == EINTR);
+
+        if (result >= 0) {
+            return static_cast<size_t>(result);
+        }
+    }
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        ec = asio::error::would_block;
+    } else {
+        ec = asio::error_code(errno, asio::error::get_system_category());
+    }
+    return 0;
+#else
+    return socket.send(asio::buffer(data, length), 0, ec);
+#endif
+}
+
+void zerocopy_sender::hold(std::vector<uint8_t>& buffer, buffer_pool& pool) {
+    uint32_t remaining = this->next_id - this->hold_id - this->unheld_completed;
+    this->unheld_completed = 0;
+
+    if (remaining == 0) {
+        // every send was copied or has completed already
+        pool.release(buffer);
+        this->hold_id = this->next_id;
+        return;
+    }
+
+    pending_buffer entry;
+    entry.first_id = this->hold_id;
+    entry.last_id = this->next_id - 1;
+    entry.remaining = remaining;
+    entry.buffer.swap(buffer);
+    this->pending.emplace_back(std::move(entry));
+
+    this->hold_id = this->next_id;
+}
+
+void zerocopy_sender::complete(asio::ip::tcp::socket& socket,
+                               buffer_pool& pool) {
+#if defined(SOCKS_HAS_ZEROCOPY)
+    for (;;) {
+        char control[128];
+        msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (::recvmsg(socket.native_handle(), &msg,
+                      MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+             cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (!(cmsg->cmsg_level == SOL_IP &&
+                  cmsg->cmsg_type == IP_RECVERR) &&
+                !(cmsg->cmsg_level == SOL_IPV6 &&
+                  cmsg->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+
+            sock_extended_err err;
+            std::memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_errno == 0 &&
+                err.ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                // ee_info and ee_data hold the range of completed sends
+                this->acknowledge(err.ee_info, err.ee_data);
+            }
+        }
+    }
+#else
+    (void)socket;
+#endif
+
+    for (auto iter = this->pending.begin(); iter != this->pending.end();) {
+        if (iter->remaining == 0) {
+            pool.release(iter->buffer);
+            iter = this->pending.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+void zerocopy_sender::clear() {
+    this->enabled = false;
+    this->lingering = false;
+    this->next_id = 0;
+    this->hold_id = 0;
+    this->unheld_completed = 0;
+    this->pending.clear();
+}
+
+void zerocopy_sender::acknowledge(uint32_t first, uint32_t last) {
+    for (auto&& entry : this->pending) {
+        uint32_t low = std::max(first, entry.first_id);
+        uint32_t high = std::min(last, entry.last_id);
+        if (low <= high) {
+            entry.remaining -= std::min(entry.remaining, high - low + 1);
+        }
+    }
+
+    // sends of the buffer still being written
+    if (this->next_id != this->hold_id) {
+        uint32_t low = std::max(first, this->hold_id);
+        uint32_t high = std::min(last, this->next_id - 1);
+        if (low <= high) {
+            this->unheld_completed += high - low + 1;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,149 @@
+// Prints an access log written by the server, one session per line :
+//
+//   start_time duration_ms client username cmd destination rep
+//   client_bytes upstream_bytes
+//
+// Fields that the session never reached are printed as -. Bytes of a
+// username or a domain name that are not printable, spaces and backslashes
+// are printed as \xNN, so every line splits into the same fields.
+
+#include <cinttypes>
+#include <cstdio>
+#include <ctime>
+
+#include "util/access_log.h"
+
+namespace {
+
+const char* command_name(uint8_t cmd) {
+    switch (cmd) {
+        case 0x01:
+            return "CONNECT";
+        case 0x02:
+            return "BIND";
+        case 0x03:
+            return "UDP_ASSOCIATE";
+        case access_record::none:
+            return "-";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+// printable ASCII but space and backslash is kept, a lone - would read as
+// a missing field
+std::string escape_field(const uint8_t* data, size_t length) {
+    std::string text;
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] > 0x20 && data[i] < 0x7f && data[i] != '\\' &&
+            !(length == 1 && data[i] == '-')) {
+            text += static_cast<char>(data[i]);
+        } else {
+            char escaped[5];
+            std::snprintf(escaped, sizeof(escaped), "\\x%02x", data[i]);
+            text += escaped;
+        }
+    }
+    return text;
+}
+
+std::string format_client(const access_record& record) {
+    if (record.client_address_length == 4) {
+        asio::ip::address_v4::bytes_type bytes;
+        std::memcpy(bytes.data(), record.client_address, bytes.size());
+        return asio::ip::address_v4(bytes).to_string() + ":" +
+               std::to_string(record.client_port);
+    }
+    asio::ip::address_v6::bytes_type bytes;
+    std::memcpy(bytes.data(), record.client_address, bytes.size());
+    return "[" + asio::ip::address_v6(bytes).to_string() +
+           "]:" + std::to_string(record.client_port);
+}
+
+std::string format_destination(const access_record& record) {
+    std::string port = std::to_string(record.dst_port);
+    if (record.dst_atyp == 0x01 && record.dst_length == 4) {
+        asio::ip::address_v4::bytes_type bytes;
+        std::memcpy(bytes.data(), record.dst_address, bytes.size());
+        return asio::ip::address_v4(bytes).to_string() + ":" + port;
+    }
+    if (record.dst_atyp == 0x04 && record.dst_length == 16) {
+        asio::ip::address_v6::bytes_type bytes;
+        std::memcpy(bytes.data(), record.dst_address, bytes.size());
+        return "[" + asio::ip::address_v6(bytes).to_string() + "]:" + port;
+    }
+    if (record.dst_atyp == 0x03) {
+        return escape_field(record.dst_address, record.dst_length) + ":" +
+               port;
+    }
+    return "-";
+}
+
+std::string format_time(uint64_t microseconds) {
+    std::time_t seconds = static_cast<std::time_t>(microseconds / 1000000);
+    char buf[64];
+    size_t length = std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S",
+                                  std::gmtime(&seconds));
+    std::snprintf(buf + length, sizeof(buf) - length, ".%06uZ",
+                  static_cast<unsigned>(microseconds % 1000000));
+    return buf;
+}
+
+}    // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::fprintf(stderr, "usage : %s <access log file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::FILE* file = std::fopen(argv[1], "rb");
+    if (file == nullptr) {
+        std::fprintf(stderr, "failed to open %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    char magic[sizeof(access_log_format::magic)];
+    if (std::fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        std::memcmp(magic, access_log_format::magic, sizeof(magic)) != 0) {
+        std::fprintf(stderr, "%s is not an access log\n", argv[1]);
+        std::fclose(file);
+        return EXIT_FAILURE;
+    }
+
+    uint8_t data[access_log_format::max_record_size];
+    access_record record;
+    for (;;) {
+        uint8_t header[2];
+        if (std::fread(header, 1, sizeof(header), file) != sizeof(header)) {
+            break;
+        }
+        size_t length = static_cast<size_t>(header[0] | header[1] << 8);
+        if (length > sizeof(data) - 2 ||
+            std::fread(data, 1, length, file) != length ||
+            !access_log_format::decode(data, length, record)) {
+            // a record cut short by a crash ends the log
+            std::fprintf(stderr, "truncated or malformed record\n");
+            std::fclose(file);
+            return EXIT_FAILURE;
+        }
+
+        std::string username =
+            escape_field(record.username, record.username_length);
+        char rep[8] = "-";
+        if (record.rep != access_record::none) {
+            std::snprintf(rep, sizeof(rep), "0x%02x", record.rep);
+        }
+        std::printf("%s %.3f %s %s %s %s %s %" PRIu64 " %" PRIu64 "\n",
+                    format_time(record.start_time).c_str(),
+                    static_cast<double>(record.duration) / 1000.0,
+                    format_client(record).c_str(),
+                    username.empty() ? "-" : username.c_str(),
+                    command_name(record.cmd),
+                    format_destination(record).c_str(), rep,
+                    record.client_bytes, record.upstream_bytes);
+    }
+
+    std::fclose(file);
+    return EXIT_SUCCESS;
+}
\ No newline at end of file